@@ -37,7 +37,7 @@ void PromiseBase::set_error() {
 
 void PromiseBase::_on_promise_finished() {
     VERBOSE(D_PRINTF("Promise (%p): Done\r\n", this));
-    if (_on_finished_callbacks.empty()) return;
+    if (_on_finished_callbacks.size() == 0) return;
 
     for (auto &callback: _on_finished_callbacks) {
         Dispatcher::dispatch([=, this] {
@@ -74,21 +74,22 @@ void PromiseBase::on_finished(FutureFinishedCb callback) {
             callback(_success);
         });
     } else {
-        _on_finished_callbacks.push_back(std::move(callback));
+        _on_finished_callbacks.push(std::move(callback));
         portEXIT_CRITICAL(&spinlock);
 
         VERBOSE(D_PRINTF("Promise (%p): Add on_finished callback\r\n", this));
     }
 }
 
-Future<void> PromiseBase::all(const std::vector<Future<void>> &collection) {
-    if (collection.empty()) return Future<void>::errored();
-    if (collection.size() == 1) return collection[0];
+Future<void> PromiseBase::all(const Future<void> *collection, size_t count) {
+    if (count == 0) return Future<void>::errored();
+    if (count == 1) return collection[0];
 
-    VERBOSE(D_PRINTF("Promise::all(): Start aggregation of %i futures\r\n", collection.size()));
+    VERBOSE(D_PRINTF("Promise::all(): Start aggregation of %i futures\r\n", count));
 
     bool already_finished = true;
-    for (const auto &future: collection) {
+    for (size_t i = 0; i < count; ++i) {
+        const auto &future = collection[i];
         if (!future.finished()) { already_finished = false; } else if (!future.success()) {
             VERBOSE(D_PRINTF("Promise::all(): Already failed\r\n"));
             return Future<void>::errored();
@@ -101,7 +102,7 @@ Future<void> PromiseBase::all(const std::vector<Future<void>> &collection) {
     }
 
     auto result_promise = Promise<void>::create();
-    auto count_left = std::make_shared<std::size_t>(collection.size());
+    auto count_left = std::make_shared<std::size_t>(count);
 
     auto finished_cb = [count_left = std::move(count_left), result_promise](bool success) {
         VERBOSE(D_PRINTF("Promise::all(): Promise finished, left: %i\r\n", *count_left - 1));
@@ -116,21 +117,22 @@ Future<void> PromiseBase::all(const std::vector<Future<void>> &collection) {
         }
     };
 
-    for (auto &future: collection) {
-        future.on_finished(finished_cb);
+    for (size_t i = 0; i < count; ++i) {
+        collection[i].on_finished(finished_cb);
         VERBOSE(delay(0)); // To avoid WDT when verbose logging
     }
 
     return Future {result_promise};
 }
 
-Future<void> PromiseBase::any(const std::vector<Future<void>> &collection) {
-    if (collection.empty()) return Future<void>::errored();
-    if (collection.size() == 1) return collection[0];
+Future<void> PromiseBase::any(const Future<void> *collection, size_t count) {
+    if (count == 0) return Future<void>::errored();
+    if (count == 1) return collection[0];
 
-    VERBOSE(D_PRINTF("Promise::any(): Start aggregation of %i futures\r\n", collection.size()));
+    VERBOSE(D_PRINTF("Promise::any(): Start aggregation of %i futures\r\n", count));
 
-    for (const auto &future: collection) {
+    for (size_t i = 0; i < count; ++i) {
+        const auto &future = collection[i];
         if (future.finished()) {
             VERBOSE(D_PRINTF("Promise::any(): Already finished with result: %s\r\n",
                 future.success() ? "Done" : "Error"));
@@ -151,7 +153,7 @@ Future<void> PromiseBase::any(const std::vector<Future<void>> &collection) {
         else result_promise->set_error();
     };
 
-    for (const auto &future: collection) { future.on_finished(finished_cb); }
+    for (size_t i = 0; i < count; ++i) { collection[i].on_finished(finished_cb); }
 
     return Future<void> {result_promise};
 }
@@ -4,12 +4,18 @@
 
 #include <Arduino.h>
 
+#include <initializer_list>
 #include <memory>
 #include <vector>
 
 #include "dispatcher.h"
 #include "future.h"
 #include "../debug.h"
+#include "../misc/small_vector.h"
+
+#ifndef PROMISE_INLINE_CALLBACKS_COUNT
+#define PROMISE_INLINE_CALLBACKS_COUNT                      (1u)                // Callbacks stored without heap allocation
+#endif
 
 class FutureBase;
 class PromiseBase;
@@ -21,7 +27,7 @@ class PromiseBase {
     volatile bool _finished = false;
     volatile bool _success = false;
 
-    std::vector<FutureFinishedCb> _on_finished_callbacks;
+    SmallVector<FutureFinishedCb, PROMISE_INLINE_CALLBACKS_COUNT> _on_finished_callbacks;
 
 #ifdef DEBUG
     int _initial_core_id = xPortGetCoreID();
@@ -40,8 +46,13 @@ public:
     [[nodiscard]] bool wait(unsigned long timeout = 0, unsigned long delay_interval = 1) const;
     void on_finished(FutureFinishedCb callback);
 
-    static Future<void> all(const std::vector<Future<void>> &collection);
-    static Future<void> any(const std::vector<Future<void>> &collection);
+    static Future<void> all(const Future<void> *collection, size_t count);
+    static Future<void> all(std::initializer_list<Future<void>> collection) { return all(collection.begin(), collection.size()); }
+    static Future<void> all(const std::vector<Future<void>> &collection) { return all(collection.data(), collection.size()); }
+
+    static Future<void> any(const Future<void> *collection, size_t count);
+    static Future<void> any(std::initializer_list<Future<void>> collection) { return any(collection.begin(), collection.size()); }
+    static Future<void> any(const std::vector<Future<void>> &collection) { return any(collection.data(), collection.size()); }
 
     template<typename T>
     static Future<T> sequential(
@@ -6,6 +6,8 @@
 #include <functional>
 #include <queue>
 
+#include "../misc/inline_function.h"
+
 #ifndef SYSTEM_TIMER_STACK_SIZE
 #define SYSTEM_TIMER_STACK_SIZE                             (4096u)
 #endif
@@ -18,6 +20,10 @@
 #define SYSTEM_TIMER_DELAY_INTERVAL_MICRO                   (1000u)
 #endif
 
+#ifndef SYSTEM_TIMER_CALLBACK_CAPACITY
+#define SYSTEM_TIMER_CALLBACK_CAPACITY                      (16u)
+#endif
+
 #ifndef SYSTEM_TIMER_TASK_RUNNING_TIMEOUT_MICRO
 #define SYSTEM_TIMER_TASK_RUNNING_TIMEOUT_MICRO             (100)
 #endif
@@ -36,7 +42,7 @@ class SystemTimer {
     static portMUX_TYPE spinlock;
 
 public:
-    typedef std::function<void()> CallbackType;
+    typedef InlineFunction<void(), SYSTEM_TIMER_CALLBACK_CAPACITY> CallbackType;
     SystemTimer() = delete;
 
     static Future<void> delay(unsigned long timeout_ms);
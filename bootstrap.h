@@ -4,6 +4,12 @@
 #include <ArduinoOTA.h>
 #include <LittleFS.h>
 
+#ifdef ARDUINO_ARCH_ESP32
+#include <esp_sleep.h>
+#else
+#include <coredecls.h>
+#endif
+
 #include "base/metadata.h"
 #include "network/web.h"
 #include "network/wifi.h"
@@ -11,6 +17,7 @@
 #include "network/server/ws.h"
 #include "misc/event_topic.h"
 #include "misc/storage.h"
+#include "misc/storage_manager.h"
 #include "utils/enum.h"
 #include "utils/qr.h"
 
@@ -22,6 +29,26 @@
 #define BOOTSTRAP_SERVICE_LOOP_INTERVAL         (20u)
 #endif
 
+#ifndef BOOTSTRAP_IDLE_MAX_WAIT
+#define BOOTSTRAP_IDLE_MAX_WAIT                 (1000u)                 // Upper bound of idle wait when there are no timers
+#endif
+
+#ifndef BOOTSTRAP_LIGHT_SLEEP_MIN_INTERVAL
+#define BOOTSTRAP_LIGHT_SLEEP_MIN_INTERVAL      (10u)                   // Shorter idle intervals are waited without sleep
+#endif
+
+/**
+ * SPIN - handle timers as fast as possible (default)
+ * IDLE_WAIT - block loop task until the nearest timer or wakeup() call
+ * LIGHT_SLEEP - (ESP32 only) enter light sleep until the nearest timer.
+ *      WiFi connection isn't maintained during sleep and wakeup sources (like GPIO) should be configured by the application
+ */
+MAKE_ENUM_AUTO(BootstrapLoopMode, uint8_t,
+    SPIN,
+    IDLE_WAIT,
+    LIGHT_SLEEP,
+)
+
 
 struct BootstrapConfig {
     const char *mdns_name;
@@ -37,6 +64,8 @@ struct BootstrapConfig {
     uint16_t mqtt_port;
     const char *mqtt_user;
     const char *mqtt_password;
+
+    BootstrapLoopMode loop_mode = BootstrapLoopMode::SPIN;
 };
 
 MAKE_ENUM_AUTO(BootstrapState, uint8_t,
@@ -56,7 +85,8 @@ class Bootstrap {
     FS *_fs;
 
     Timer _timer;
-    Storage<ConfigT> _config_storage;
+    StorageManager _storage_manager{_timer};
+    Storage<ConfigT> &_config_storage;
     WebServer _web_server{};
 
     BootstrapState _state = BootstrapState::UNINITIALIZED;
@@ -66,6 +96,12 @@ class Bootstrap {
 
     EventTopic<BootstrapState> _event_state_changed;
 
+#ifdef ARDUINO_ARCH_ESP32
+    TaskHandle_t _loop_task = nullptr;
+#else
+    volatile bool _wakeup_pending = false;
+#endif
+
 public:
     explicit Bootstrap(FS *fs);
 
@@ -73,15 +109,20 @@ public:
 
     inline EventTopic<BootstrapState> &event_state_changed() { return _event_state_changed; }
     inline Timer &timer() { return _timer; }
+    inline StorageManager &storage_manager() { return _storage_manager; }
     inline auto &wifi_manager() { return _wifi_manager; }
 
     inline auto &web_server() { return _web_server; }
     inline auto &ws_server() { return _ws_server; }
     inline auto &mqtt_server() { return _mqtt_server; }
 
+    // Should be called from the task which runs event_loop()
     void begin(BootstrapConfig bootstrap_config);
     void event_loop();
 
+    // Interrupt idle wait of the event loop. Safe to call from ISR or another task
+    void wakeup();
+
     void save_changes();
     void restart();
 
@@ -89,23 +130,37 @@ private:
     void _change_state(BootstrapState state);
     void _after_init();
     void _service_loop();
+    void _idle_wait();
 };
 
 
 template<typename ConfigT, typename PacketEnumT>
-Bootstrap<ConfigT, PacketEnumT>::Bootstrap(FS *fs) : _fs(fs), _config_storage(_timer, "config") {
-    _config_storage.begin(_fs);
+Bootstrap<ConfigT, PacketEnumT>::Bootstrap(FS *fs) :
+        _fs(fs), _config_storage(_storage_manager.create<ConfigT>("config")) {
+    _storage_manager.begin(_fs);
 }
 
 template<typename ConfigT, typename PacketEnumT>
 void Bootstrap<ConfigT, PacketEnumT>::begin(BootstrapConfig bootstrap_config) {
     _bootstrap_config = bootstrap_config;
 
+#ifdef ARDUINO_ARCH_ESP32
+    // Captured before any wakeup source is registered, notification given before the first idle wait stays pending
+    _loop_task = xTaskGetCurrentTaskHandle();
+#endif
+
+#if TIMER_INBOX_SIZE > 0
+    _timer.set_wakeup_callback([this] { wakeup(); });
+#endif
+
     _wifi_manager = std::make_unique<WifiManager>(_bootstrap_config.wifi_ssid, _bootstrap_config.wifi_password);
     _ws_server = std::make_unique<WebSocketServer<PacketEnumT>>();
     _mqtt_server = std::make_unique<MqttServer>();
 
-    _timer.add_interval([this](auto) { this->_service_loop(); }, BOOTSTRAP_SERVICE_LOOP_INTERVAL);
+    [[maybe_unused]] auto service_timer = _timer.add_interval([this](auto) { this->_service_loop(); }, BOOTSTRAP_SERVICE_LOOP_INTERVAL);
+#ifdef TIMER_PROFILING
+    _timer.set_name(service_timer, "bootstrap_service_loop");
+#endif
 }
 
 template<typename ConfigT, typename PacketEnumT>
@@ -116,6 +171,55 @@ void Bootstrap<ConfigT, PacketEnumT>::save_changes() {
 template<typename ConfigT, typename PacketEnumT>
 void Bootstrap<ConfigT, PacketEnumT>::event_loop() {
     _timer.handle_timers();
+
+    if (_bootstrap_config.loop_mode != BootstrapLoopMode::SPIN) _idle_wait();
+}
+
+template<typename ConfigT, typename PacketEnumT>
+void Bootstrap<ConfigT, PacketEnumT>::wakeup() {
+#ifdef ARDUINO_ARCH_ESP32
+    // Not started yet, the first event_loop() call handles everything posted before
+    if (_loop_task == nullptr) return;
+
+    if (xPortInIsrContext()) {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(_loop_task, &woken);
+        portYIELD_FROM_ISR(woken);
+    } else {
+        xTaskNotifyGive(_loop_task);
+    }
+#else
+    _wakeup_pending = true;
+    esp_schedule();
+#endif
+}
+
+template<typename ConfigT, typename PacketEnumT>
+void Bootstrap<ConfigT, PacketEnumT>::_idle_wait() {
+    unsigned long wait = BOOTSTRAP_IDLE_MAX_WAIT;
+
+    unsigned long deadline;
+    if (_timer.next_deadline(deadline)) {
+        const auto left = (long) (deadline - millis());
+        if (left <= 0) return;
+
+        wait = std::min<unsigned long>(wait, left);
+    }
+
+    VERBOSE(D_PRINTF("Bootstrap: idle for %lu ms\r\n", wait));
+
+#ifdef ARDUINO_ARCH_ESP32
+    if (_bootstrap_config.loop_mode == BootstrapLoopMode::LIGHT_SLEEP && wait >= BOOTSTRAP_LIGHT_SLEEP_MIN_INTERVAL) {
+        esp_sleep_enable_timer_wakeup(wait * 1000ull);
+        esp_light_sleep_start();
+        return;
+    }
+
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait));
+#else
+    esp_delay(wait, [this] { return !_wakeup_pending; });
+    _wakeup_pending = false;
+#endif
 }
 
 template<typename ConfigT, typename PacketEnumT>
@@ -155,7 +259,7 @@ template<typename ConfigT, typename PacketEnumT>
 void Bootstrap<ConfigT, PacketEnumT>::restart() {
     D_PRINTF("Received restart signal. Restarting after %u ms.\r\n", RESTART_DELAY);
 
-    if (_config_storage.is_pending_commit()) _config_storage.force_save();
+    _storage_manager.flush();
 
     _timer.add_timeout([](auto) { ESP.restart(); }, RESTART_DELAY);
 }
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "../debug.h"
+
+struct ByteSpan {
+    uint8_t *data = nullptr;
+    size_t size = 0;
+
+    explicit operator bool() const { return data != nullptr; }
+};
+
+/**
+ * Lock-free single-producer single-consumer ring of variable-length byte records.
+ *
+ * Record is stored contiguously as [length] [data] aligned to 4 bytes, so memory is spent on the actual data only.
+ * When record doesn't fit before the end of the buffer, the rest is marked as padding and record starts from the beginning.
+ * Record less than half of the buffer always fits into the empty buffer.
+ *
+ * Producer writes into span returned by acquire(size) and publishes it with commit(),
+ * consumer reads span returned by peek() in place and frees it with release().
+ */
+template<size_t Size>
+class ByteCircularBuffer {
+    using Header = uint32_t;
+
+    static constexpr size_t Alignment = sizeof(Header);
+    static constexpr size_t Capacity = Size / Alignment * Alignment;
+    static constexpr Header PaddingMarker = ~(Header) 0;
+
+    static_assert(Capacity >= 2 * Alignment, "Size is too small");
+
+    alignas(Header) uint8_t _buffer[Capacity] = {};
+
+    std::atomic<size_t> _head{0}; // Written by producer only
+    std::atomic<size_t> _tail{0}; // Written by consumer only
+
+    size_t _acquired_offset = 0;
+    size_t _acquired_size = 0;
+
+public:
+    ByteCircularBuffer() = default;
+
+    ByteCircularBuffer(const ByteCircularBuffer &) = delete;
+    ByteCircularBuffer &operator=(const ByteCircularBuffer &) = delete;
+
+    [[nodiscard]] inline size_t size() const { return Capacity; }
+
+    [[nodiscard]] inline bool empty() const {
+        return _tail.load(std::memory_order_acquire) == _head.load(std::memory_order_acquire);
+    }
+
+    // Producer side
+
+    // Returns empty span if there is no room, the same place is returned until commit()
+    ByteSpan acquire(size_t size);
+
+    // Publish acquired record, size can be reduced
+    void commit();
+    void commit(size_t size);
+
+    // Consumer side
+
+    // Returns the oldest record or empty span, the same record is returned until release()
+    ByteSpan peek();
+    void release();
+
+private:
+    static constexpr size_t _record_size(size_t size) {
+        return (sizeof(Header) + size + Alignment - 1) / Alignment * Alignment;
+    }
+
+    static constexpr size_t _normalize(size_t offset) { return offset < Capacity ? offset : 0; }
+
+    inline Header _read_header(size_t offset) const {
+        Header header;
+        memcpy(&header, _buffer + offset, sizeof(header));
+
+        return header;
+    }
+
+    inline void _write_header(size_t offset, Header header) { memcpy(_buffer + offset, &header, sizeof(header)); }
+};
+
+template<size_t Size>
+ByteSpan ByteCircularBuffer<Size>::acquire(size_t size) {
+    if (size >= PaddingMarker) return {};
+
+    const size_t record_size = _record_size(size);
+
+    const auto head = _head.load(std::memory_order_relaxed);
+    const auto tail = _tail.load(std::memory_order_acquire);
+
+    // Head must not reach the tail, otherwise the buffer looks empty
+    size_t offset;
+    if (head >= tail) {
+        if (head + record_size < Capacity || (head + record_size == Capacity && tail != 0)) {
+            offset = head;
+        } else if (record_size < tail) {
+            offset = 0;
+        } else {
+            return {};
+        }
+    } else if (head + record_size < tail) {
+        offset = head;
+    } else {
+        return {};
+    }
+
+    // Not visible to consumer until commit()
+    if (offset != head) _write_header(head, PaddingMarker);
+
+    _acquired_offset = offset;
+    _acquired_size = size;
+
+    VERBOSE(D_PRINTF("ByteCircularBuffer: Acquire %u bytes at %u\r\n", size, offset));
+    return {_buffer + offset + sizeof(Header), size};
+}
+
+template<size_t Size>
+void ByteCircularBuffer<Size>::commit() {
+    commit(_acquired_size);
+}
+
+template<size_t Size>
+void ByteCircularBuffer<Size>::commit(size_t size) {
+    if (size > _acquired_size) {
+        D_PRINTF("ByteCircularBuffer: Commit size %u exceeds acquired %u\r\n", size, _acquired_size);
+        size = _acquired_size;
+    }
+
+    _write_header(_acquired_offset, (Header) size);
+
+    // Release order makes record content visible before the new head
+    _head.store(_normalize(_acquired_offset + _record_size(size)), std::memory_order_release);
+    _acquired_size = 0;
+}
+
+template<size_t Size>
+ByteSpan ByteCircularBuffer<Size>::peek() {
+    auto tail = _tail.load(std::memory_order_relaxed);
+    if (tail == _head.load(std::memory_order_acquire)) return {};
+
+    auto header = _read_header(tail);
+    if (header == PaddingMarker) {
+        tail = 0;
+        header = _read_header(tail);
+    }
+
+    return {_buffer + tail + sizeof(Header), header};
+}
+
+template<size_t Size>
+void ByteCircularBuffer<Size>::release() {
+    auto tail = _tail.load(std::memory_order_relaxed);
+    if (tail == _head.load(std::memory_order_acquire)) return;
+
+    auto header = _read_header(tail);
+    if (header == PaddingMarker) {
+        tail = 0;
+        header = _read_header(tail);
+    }
+
+    _tail.store(_normalize(tail + _record_size(header)), std::memory_order_release);
+}
@@ -1,11 +1,34 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
+#include <iterator>
 #include <type_traits>
 
 #include "../debug.h"
 
-template<typename T, size_t Size, typename = std::enable_if_t<std::is_standard_layout_v<T>>>
+template<typename T>
+struct CircularBufferSpan {
+    T *data = nullptr;
+    size_t size = 0;
+};
+
+// Live range is stored in up to two contiguous parts: first is older than second
+template<typename T>
+struct CircularBufferView {
+    CircularBufferSpan<T> first;
+    CircularBufferSpan<T> second;
+
+    [[nodiscard]] inline size_t size() const { return first.size + second.size; }
+};
+
+/**
+ * Fixed-size FIFO buffer.
+ *
+ * When Overwrite is set, acquire() never fails: the oldest value is dropped when the buffer is full,
+ * so buffer keeps the newest Size values, e.g. history of samples.
+ */
+template<typename T, size_t Size, bool Overwrite = false, typename = std::enable_if_t<std::is_standard_layout_v<T>>>
 class CircularBuffer {
     T _buffer[Size] = {};
 
@@ -13,19 +36,44 @@ class CircularBuffer {
     size_t _next_index = 0;
 
 public:
+    template<typename V>
+    class Iterator {
+        V *_owner;
+        size_t _index;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::remove_const_t<decltype(std::declval<V &>()._buffer[0])>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = decltype(&std::declval<V &>()._buffer[0]);
+        using reference = decltype(std::declval<V &>()._buffer[0]);
+
+        Iterator(V *owner, size_t index) : _owner(owner), _index(index) {}
+
+        reference operator*() const { return _owner->_buffer[_owner->_physical_index(_index)]; }
+        pointer operator->() const { return &**this; }
+
+        Iterator &operator++() { ++_index; return *this; }
+        Iterator operator++(int) { auto result = *this; ++_index; return result; }
+
+        bool operator==(const Iterator &other) const { return _owner == other._owner && _index == other._index; }
+        bool operator!=(const Iterator &other) const { return !(*this == other); }
+    };
+
     [[nodiscard]] inline T *buffer() { return _buffer; }
     [[nodiscard]] inline size_t size() const { return Size; }
+    [[nodiscard]] inline size_t used() const { return _used; }
 
-    [[nodiscard]] inline bool can_acquire() const { return _used < Size; }
+    [[nodiscard]] inline bool can_acquire() const { return Overwrite || _used < Size; }
     [[nodiscard]] inline bool can_pop() const { return _used != 0; }
 
     T *acquire() {
         if (!can_acquire()) return nullptr;
 
-        VERBOSE(D_PRINTF("Acquire value at %u; Used: %u / %u\r\n", _next_index, _used + 1, Size));
+        VERBOSE(D_PRINTF("Acquire value at %u; Used: %u / %u\r\n", _next_index, std::min(_used + 1, Size), Size));
 
         auto value = &_buffer[_next_index];
-        _used++;
+        if (_used < Size) _used++;
         if (++_next_index >= Size) _next_index = 0;
 
         return value;
@@ -34,11 +82,91 @@ public:
     T *pop() {
         if (!can_pop()) return nullptr;
 
-        const auto index = (Size + _next_index - _used) % Size;
+        const auto index = _physical_index(0);
         _used--;
 
         VERBOSE(D_PRINTF("Pop value at %u; Used: %u / %u\r\n", index, _used, Size));
 
         return &_buffer[index];
     }
+
+    // Oldest value, index counts from it
+    T *peek(size_t index = 0) {
+        if (index >= _used) return nullptr;
+        return &_buffer[_physical_index(index)];
+    }
+
+    const T *peek(size_t index = 0) const { return const_cast<CircularBuffer *>(this)->peek(index); }
+
+    // Copy up to count oldest values, returns number of copied values
+    size_t peek_n(T *out, size_t count) const;
+
+    // Same as peek_n, but copied values are removed
+    size_t pop_n(T *out, size_t count);
+
+    // Contiguous parts of the newest count values, from the oldest to the newest
+    CircularBufferView<T> view(size_t count = Size);
+    CircularBufferView<const T> view(size_t count = Size) const;
+
+    void clear() {
+        _used = 0;
+        _next_index = 0;
+    }
+
+    // Iterate from the oldest to the newest value
+    Iterator<CircularBuffer> begin() { return {this, 0}; }
+    Iterator<CircularBuffer> end() { return {this, _used}; }
+
+    Iterator<const CircularBuffer> begin() const { return {this, 0}; }
+    Iterator<const CircularBuffer> end() const { return {this, _used}; }
+
+private:
+    [[nodiscard]] inline size_t _physical_index(size_t index) const {
+        return (Size + _next_index - _used + index) % Size;
+    }
+
+    template<typename V>
+    static CircularBufferView<V> _view(V *buffer, size_t start, size_t count);
 };
+
+template<typename T, size_t Size, bool Overwrite, typename S1>
+size_t CircularBuffer<T, Size, Overwrite, S1>::peek_n(T *out, size_t count) const {
+    const auto parts = _view(_buffer, _physical_index(0), std::min(count, _used));
+
+    std::copy_n(parts.first.data, parts.first.size, out);
+    std::copy_n(parts.second.data, parts.second.size, out + parts.first.size);
+
+    return parts.size();
+}
+
+template<typename T, size_t Size, bool Overwrite, typename S1>
+size_t CircularBuffer<T, Size, Overwrite, S1>::pop_n(T *out, size_t count) {
+    const auto result = peek_n(out, count);
+    _used -= result;
+
+    VERBOSE(D_PRINTF("Pop %u values; Used: %u / %u\r\n", result, _used, Size));
+    return result;
+}
+
+template<typename T, size_t Size, bool Overwrite, typename S1>
+CircularBufferView<T> CircularBuffer<T, Size, Overwrite, S1>::view(size_t count) {
+    count = std::min(count, _used);
+    return _view(_buffer, (Size + _next_index - count) % Size, count);
+}
+
+template<typename T, size_t Size, bool Overwrite, typename S1>
+CircularBufferView<const T> CircularBuffer<T, Size, Overwrite, S1>::view(size_t count) const {
+    count = std::min(count, _used);
+    return _view(_buffer, (Size + _next_index - count) % Size, count);
+}
+
+template<typename T, size_t Size, bool Overwrite, typename S1>
+template<typename V>
+CircularBufferView<V> CircularBuffer<T, Size, Overwrite, S1>::_view(V *buffer, size_t start, size_t count) {
+    const size_t first = std::min(count, Size - start);
+
+    return {
+        {buffer + start, first},
+        {buffer, count - first}
+    };
+}
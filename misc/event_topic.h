@@ -1,11 +1,15 @@
 #pragma once
 
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <type_traits>
 #include <unordered_map>
 #include <unordered_set>
 
+#include "./vector.h"
+#include "../debug.h"
+
 template<typename T, typename = std::enable_if_t<std::is_enum_v<T>>>
 class Subscription {
 public:
@@ -31,7 +35,7 @@ private:
 };
 
 template<typename T, typename = std::enable_if_t<std::is_enum_v<T>>>
-class EventTopic {
+class HashEventTopic {
     typedef std::unordered_set<Subscription<T>, typename Subscription<T>::HashFunction> SubscriptionsSetT;
 
     std::unordered_map<T, SubscriptionsSetT> _subscribers{};
@@ -47,18 +51,18 @@ public:
 };
 
 template<typename T, typename S1>
-void EventTopic<T, S1>::subscribe(void *target, EventTopic::SubscriptionCallback callback) {
+void HashEventTopic<T, S1>::subscribe(void *target, HashEventTopic::SubscriptionCallback callback) {
     _broadcast_subscribers.emplace(target, callback);
 }
 
 template<typename T, typename S1>
-void EventTopic<T, S1>::subscribe(void *target, T type, EventTopic::SubscriptionCallback callback) {
+void HashEventTopic<T, S1>::subscribe(void *target, T type, HashEventTopic::SubscriptionCallback callback) {
     auto &type_set = _subscribers[type];
     type_set.emplace(Subscription(target, callback));
 }
 
 template<typename T, typename S1>
-void EventTopic<T, S1>::publish(void *sender, T type, void *arg) {
+void HashEventTopic<T, S1>::publish(void *sender, T type, void *arg) {
     for (auto &sub: _broadcast_subscribers) {
         sub.call(sender, type, arg);
     }
@@ -70,3 +74,137 @@ void EventTopic<T, S1>::publish(void *sender, T type, void *arg) {
         sub.call(sender, type, arg);
     }
 }
+
+/**
+ * EventTopic indexed by enum value: subscribers of all types are stored in a single flat array grouped by type,
+ * so publish() is a direct index and a linear walk without hashing or allocation.
+ *
+ * Size is taken from MAKE_ENUM / MAKE_ENUM_AUTO, for other enums pass max value + 1.
+ * Subscribing from the callback is deferred until the outermost publish() returns,
+ * so the arrays aren't reallocated while they are walked.
+ */
+template<typename T, size_t Size = __enum_size(T{}), typename = std::enable_if_t<std::is_enum_v<T>>>
+class DenseEventTopic {
+    static_assert(Size > 0 && Size < UINT16_MAX, "Unsupported Size value");
+
+    typedef Subscription<T> SubscriptionT;
+
+    // Subscriptions of type are in [_offsets[type], _offsets[type + 1])
+    Vector<SubscriptionT> _subscribers{};
+    uint16_t _offsets[Size + 1] = {};
+
+    Vector<SubscriptionT> _broadcast_subscribers{};
+
+    // Subscriptions made during publish(), index is Size for the broadcast one
+    struct PendingSubscription {
+        size_t index;
+        SubscriptionT subscription;
+
+        PendingSubscription(size_t index, SubscriptionT subscription) : index(index), subscription(std::move(subscription)) {}
+    };
+
+    Vector<PendingSubscription> _pending{};
+    uint8_t _publishing = 0;
+
+public:
+    typedef typename SubscriptionT::SubscriptionCallback SubscriptionCallback;
+
+    void subscribe(void *target, T type, SubscriptionCallback callback);
+    void subscribe(void *target, SubscriptionCallback callback);
+
+    void publish(void *sender, T type, void *arg = nullptr);
+
+private:
+    void _add(size_t index, SubscriptionT subscription);
+    void _apply_pending();
+
+    static bool _contains(const SubscriptionT *begin, const SubscriptionT *end, const SubscriptionT &subscription);
+};
+
+template<typename T, size_t Size, typename S1>
+void DenseEventTopic<T, Size, S1>::subscribe(void *target, DenseEventTopic::SubscriptionCallback callback) {
+    _add(Size, SubscriptionT(target, std::move(callback)));
+}
+
+template<typename T, size_t Size, typename S1>
+void DenseEventTopic<T, Size, S1>::subscribe(void *target, T type, DenseEventTopic::SubscriptionCallback callback) {
+    const auto index = (size_t) type;
+    if (index >= Size) {
+        D_PRINTF("DenseEventTopic: Type %u is out of range\r\n", index);
+        return;
+    }
+
+    _add(index, SubscriptionT(target, std::move(callback)));
+}
+
+template<typename T, size_t Size, typename S1>
+void DenseEventTopic<T, Size, S1>::publish(void *sender, T type, void *arg) {
+    ++_publishing;
+
+    for (auto &sub: _broadcast_subscribers) {
+        sub.call(sender, type, arg);
+    }
+
+    const auto index = (size_t) type;
+    if (index < Size) {
+        auto *subscribers = _subscribers.data();
+        for (size_t i = _offsets[index]; i < _offsets[index + 1]; ++i) {
+            subscribers[i].call(sender, type, arg);
+        }
+    }
+
+    if (--_publishing == 0 && _pending.size() > 0) _apply_pending();
+}
+
+template<typename T, size_t Size, typename S1>
+void DenseEventTopic<T, Size, S1>::_add(size_t index, SubscriptionT subscription) {
+    if (_publishing > 0) {
+        _pending.emplace(index, std::move(subscription));
+        return;
+    }
+
+    if (index == Size) {
+        if (_contains(_broadcast_subscribers.begin(), _broadcast_subscribers.end(), subscription)) return;
+
+        _broadcast_subscribers.push(std::move(subscription));
+        return;
+    }
+
+    auto *subscribers = _subscribers.data();
+    if (_contains(subscribers + _offsets[index], subscribers + _offsets[index + 1], subscription)) return;
+
+    _subscribers.insert(_offsets[index + 1], std::move(subscription));
+    for (size_t i = index + 1; i <= Size; ++i) ++_offsets[i];
+}
+
+template<typename T, size_t Size, typename S1>
+void DenseEventTopic<T, Size, S1>::_apply_pending() {
+    auto pending = std::move(_pending);
+    for (auto &entry: pending) {
+        _add(entry.index, std::move(entry.subscription));
+    }
+}
+
+template<typename T, size_t Size, typename S1>
+bool DenseEventTopic<T, Size, S1>::_contains(const SubscriptionT *begin, const SubscriptionT *end,
+                                             const SubscriptionT &subscription) {
+    for (auto *it = begin; it != end; ++it) {
+        if (*it == subscription) return true;
+    }
+
+    return false;
+}
+
+template<typename T, typename = void>
+struct __event_topic_impl {
+    typedef HashEventTopic<T> type;
+};
+
+template<typename T>
+struct __event_topic_impl<T, std::void_t<decltype(__enum_size(T{}))>> {
+    typedef DenseEventTopic<T> type;
+};
+
+// Enums declared by MAKE_ENUM / MAKE_ENUM_AUTO get DenseEventTopic, other enums fall back to HashEventTopic
+template<typename T, typename = std::enable_if_t<std::is_enum_v<T>>>
+using EventTopic = typename __event_topic_impl<T>::type;
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "../debug.h"
+
+#ifdef CONFIG_CXX_EXCEPTIONS
+#include <functional>
+#endif
+
+template<typename Signature, size_t Capacity = 2 * sizeof(void *)>
+class InlineFunction;
+
+/**
+ * Move-only replacement of std::function which never allocates memory.
+ * Callable is stored inside the object, so its size is limited by Capacity and checked at compile time.
+ */
+template<typename R, typename... Args, size_t Capacity>
+class InlineFunction<R(Args...), Capacity> {
+    typedef R (*InvokeFn)(void *storage, Args &&... args);
+    typedef void (*ManageFn)(void *storage, void *from);    // Move-construct from "from" or destroy if it's nullptr
+
+    alignas(std::max_align_t) uint8_t _storage[Capacity] = {};
+
+    InvokeFn _invoke = nullptr;
+    ManageFn _manage = nullptr;
+
+public:
+    InlineFunction() = default;
+    InlineFunction(std::nullptr_t) {} // NOLINT(*-explicit-constructor)
+
+    template<typename F, typename FnT = std::decay_t<F>,
+        typename = std::enable_if_t<!std::is_same_v<FnT, InlineFunction> && std::is_invocable_r_v<R, FnT &, Args...>>>
+    InlineFunction(F &&fn); // NOLINT(*-explicit-constructor)
+
+    InlineFunction(InlineFunction &&other) noexcept;
+    InlineFunction &operator=(InlineFunction &&other) noexcept;
+    InlineFunction &operator=(std::nullptr_t) noexcept;
+
+    InlineFunction(const InlineFunction &) = delete;
+    InlineFunction &operator=(const InlineFunction &) = delete;
+
+    ~InlineFunction() { reset(); }
+
+    void reset() noexcept;
+
+    R operator()(Args... args) const;
+
+    explicit operator bool() const { return _invoke != nullptr; }
+
+    bool operator==(std::nullptr_t) const { return _invoke == nullptr; }
+    bool operator!=(std::nullptr_t) const { return _invoke != nullptr; }
+};
+
+template<typename R, typename... Args, size_t Capacity>
+template<typename F, typename FnT, typename>
+InlineFunction<R(Args...), Capacity>::InlineFunction(F &&fn) {
+    static_assert(sizeof(FnT) <= Capacity, "InlineFunction: callable is too big, reduce captures or increase Capacity");
+    static_assert(alignof(FnT) <= alignof(std::max_align_t), "InlineFunction: unsupported callable alignment");
+
+    new(_storage) FnT(std::forward<F>(fn));
+
+    _invoke = [](void *storage, Args &&... args) -> R {
+        return (*(FnT *) storage)(std::forward<Args>(args)...);
+    };
+
+    _manage = [](void *storage, void *from) {
+        if (from) {
+            new(storage) FnT(std::move(*(FnT *) from));
+        } else {
+            ((FnT *) storage)->~FnT();
+        }
+    };
+}
+
+template<typename R, typename... Args, size_t Capacity>
+InlineFunction<R(Args...), Capacity>::InlineFunction(InlineFunction &&other) noexcept {
+    *this = std::move(other);
+}
+
+template<typename R, typename... Args, size_t Capacity>
+InlineFunction<R(Args...), Capacity> &InlineFunction<R(Args...), Capacity>::operator=(InlineFunction &&other) noexcept {
+    if (this == &other) return *this;
+
+    reset();
+    if (!other._invoke) return *this;
+
+    other._manage(_storage, other._storage);
+    _invoke = other._invoke;
+    _manage = other._manage;
+
+    other.reset();
+    return *this;
+}
+
+template<typename R, typename... Args, size_t Capacity>
+InlineFunction<R(Args...), Capacity> &InlineFunction<R(Args...), Capacity>::operator=(std::nullptr_t) noexcept {
+    reset();
+    return *this;
+}
+
+template<typename R, typename... Args, size_t Capacity>
+void InlineFunction<R(Args...), Capacity>::reset() noexcept {
+    if (!_manage) return;
+
+    _manage(_storage, nullptr);
+
+    _invoke = nullptr;
+    _manage = nullptr;
+}
+
+template<typename R, typename... Args, size_t Capacity>
+R InlineFunction<R(Args...), Capacity>::operator()(Args... args) const {
+    if (!_invoke) {
+        D_PRINT("InlineFunction: Call of empty function");
+#ifdef CONFIG_CXX_EXCEPTIONS
+        throw std::bad_function_call();
+#else
+        abort();
+#endif
+    }
+
+    return _invoke((void *) _storage, std::forward<Args>(args)...);
+}
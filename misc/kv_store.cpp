@@ -0,0 +1,710 @@
+#include "./kv_store.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "../debug.h"
+#include "../utils/crc.h"
+
+KvStore::KvStore(Timer &timer, const char *name) : _timer(timer), _name(name) {}
+
+KvStore::~KvStore() {
+    if (_compact_timer_id != TIMER_INVALID_ID) _timer.clear_timeout(_compact_timer_id);
+
+    flush();
+    if (_flush_timer_id != TIMER_INVALID_ID) _timer.clear_timeout(_flush_timer_id);
+
+    delete[] _index;
+}
+
+bool KvStore::begin(FS *fs) {
+    _fs_backend = std::make_unique<StorageFsBackend>(fs);
+    return begin(_fs_backend.get());
+}
+
+bool KvStore::begin(StorageBackend *backend) {
+    if (!backend->supports_append()) {
+        D_PRINTF("KvStore(%s): Backend doesn't support appends\r\n", _name);
+        return false;
+    }
+
+    _backend = backend;
+
+    if (!_index) {
+        _index_capacity = KV_STORE_INDEX_CAPACITY;
+        _index = new KvIndexEntry[_index_capacity];
+    }
+
+    if (!_load_manifest()) {
+        D_PRINTF("KvStore(%s): Store is empty\r\n", _name);
+        return true;
+    }
+
+    for (auto &segment: _segments) {
+        // Only the active segment can have a torn tail, new records go to the next segment
+        if (!_replay(segment) && &segment == &_segments.back()) _broken = true;
+    }
+
+    D_PRINTF("KvStore(%s): Loaded %u keys from %u segments\r\n", _name, _count, _segments.size());
+
+    _schedule_compaction();
+    return true;
+}
+
+bool KvStore::put(const char *key, const void *data, size_t size) {
+    const size_t key_length = key ? strlen(key) : 0;
+    if (!_backend || key_length == 0 || key_length >= KV_STORE_KEY_SIZE || size > KV_STORE_VALUE_MAX_SIZE) {
+        D_PRINTF("KvStore(%s): Unable to put key %s, size %u\r\n", _name, key ? key : "", size);
+        return false;
+    }
+
+    auto *entry = _find(key);
+    if (entry && _equals(*entry, data, size)) return true;
+
+    uint16_t segment;
+    uint32_t offset;
+
+    auto *record = _reserve(_record_size(key_length, size), segment, offset);
+    if (!record) return false;
+
+    _fill_record(record, KvRecordType::PUT, key, key_length, data, size);
+
+    if (entry) {
+        _release(*entry);
+    } else {
+        entry = _insert(key);
+    }
+
+    _set_location(*entry, segment, offset, size);
+    return true;
+}
+
+size_t KvStore::get(const char *key, void *data, size_t size) const {
+    const auto *entry = _find(key);
+    if (!entry) return 0;
+
+    const size_t length = std::min(size, (size_t) entry->size);
+    if (length > 0 && _read_value(*entry, 0, data, length) != length) return 0;
+
+    return entry->size;
+}
+
+bool KvStore::remove(const char *key) {
+    auto *entry = _find(key);
+    if (!entry) return false;
+
+    const size_t key_length = strlen(key);
+
+    uint16_t segment;
+    uint32_t offset;
+
+    // Tombstone hides records of the key in older segments
+    auto *record = _reserve(_record_size(key_length, 0), segment, offset);
+    if (!record) return false;
+
+    _fill_record(record, KvRecordType::REMOVE, key, key_length, nullptr, 0);
+    _get_segment(segment)->tombstones += _record_size(key_length, 0);
+
+    _release(*entry);
+    _erase(entry);
+
+    return true;
+}
+
+size_t KvStore::value_size(const char *key) const {
+    const auto *entry = _find(key);
+    return entry ? entry->size : 0;
+}
+
+size_t KvStore::storage_size() const {
+    size_t result = _buffer_size;
+    for (auto &segment: _segments) result += segment.size;
+
+    return result;
+}
+
+size_t KvStore::garbage_size() const {
+    // Pending records are counted as live by the active segment, so totals are compared
+    size_t live = 0;
+    for (auto &segment: _segments) live += _live_size(segment);
+
+    return storage_size() - live;
+}
+
+bool KvStore::flush() {
+    if (_flush_timer_id != TIMER_INVALID_ID) {
+        _timer.clear_timeout(_flush_timer_id);
+        _flush_timer_id = TIMER_INVALID_ID;
+    }
+
+    if (!_backend || _buffer_size == 0) return true;
+
+    if (_broken && !_move_pending()) {
+        _schedule_flush();
+        return false;
+    }
+
+    auto &segment = _active();
+    const String key = _segment_key(segment.id);
+
+    const StorageChunk chunk{_buffer, _buffer_size};
+    const size_t written = _backend->append(key.c_str(), &chunk, 1);
+
+    if (written != _buffer_size) {
+        D_PRINTF("KvStore(%s): Append to segment %u failed, written %u of %u\r\n", _name, segment.id, written, _buffer_size);
+
+        // Pending records will be moved to the new segment on the next attempt
+        _broken = true;
+        _schedule_flush();
+
+        return false;
+    }
+
+    segment.size += written;
+    _buffer_size = 0;
+
+    VERBOSE(D_PRINTF("KvStore(%s): Flushed %u bytes to segment %u\r\n", _name, written, segment.id));
+    return true;
+}
+
+size_t KvStore::compact() {
+    size_t compacted = 0;
+
+    // Active segment is never compacted, but compaction can seal it by opening a new one
+    for (size_t i = 0; i + 1 < _segments.size();) {
+        if (!_needs_compaction(_segments[i])) {
+            ++i;
+            continue;
+        }
+
+        if (!_compact_segment(_segments[i].id)) break;
+        compacted++;
+    }
+
+    return compacted;
+}
+
+KvSegment *KvStore::_get_segment(uint16_t id) {
+    for (auto &segment: _segments) {
+        if (segment.id == id) return &segment;
+    }
+
+    return nullptr;
+}
+
+bool KvStore::_is_pending(const KvIndexEntry &entry) const {
+    return !_segments.empty() && entry.segment == _segments.back().id && entry.offset >= _segments.back().size;
+}
+
+bool KvStore::_load_manifest() {
+    // Manifest: [magic] [count] { [segment id] } * count [crc]
+    if (!_backend->exists(_name)) return false;
+
+    const size_t size = _backend->size(_name);
+    constexpr size_t fixed_size = sizeof(KV_STORE_MAGIC) + sizeof(uint16_t) + sizeof(uint32_t);
+
+    if (size < fixed_size || (size - fixed_size) % sizeof(uint16_t) != 0) {
+        D_PRINTF("KvStore(%s): Bad manifest size %u\r\n", _name, size);
+        return false;
+    }
+
+    auto *buffer = new uint8_t[size];
+    const bool read = _backend->read(_name, 0, buffer, size) == size;
+
+    uint32_t magic, crc;
+    uint16_t count;
+
+    memcpy(&magic, buffer, sizeof(magic));
+    memcpy(&count, buffer + sizeof(magic), sizeof(count));
+    memcpy(&crc, buffer + size - sizeof(crc), sizeof(crc));
+
+    const bool valid = read && magic == KV_STORE_MAGIC
+                       && count == (size - fixed_size) / sizeof(uint16_t)
+                       && crc == crc32_calc(buffer, size - sizeof(crc));
+
+    if (valid) {
+        const uint8_t *ptr = buffer + sizeof(magic) + sizeof(count);
+        for (uint16_t i = 0; i < count; ++i, ptr += sizeof(uint16_t)) {
+            uint16_t id;
+            memcpy(&id, ptr, sizeof(id));
+
+            _segments.push_back({id, 0, 0, 0});
+            _next_segment_id = id + 1;
+        }
+    } else {
+        D_PRINTF("KvStore(%s): Manifest is corrupted\r\n", _name);
+    }
+
+    delete[] buffer;
+    return valid;
+}
+
+bool KvStore::_write_manifest() {
+    const uint32_t magic = KV_STORE_MAGIC;
+    const auto count = (uint16_t) _segments.size();
+
+    std::vector<uint16_t> ids;
+    ids.reserve(count);
+
+    for (auto &segment: _segments) ids.push_back(segment.id);
+
+    uint32_t crc = crc32_calc(&magic, sizeof(magic));
+    crc = crc32_calc(&count, sizeof(count), crc);
+    crc = crc32_calc(ids.data(), count * sizeof(uint16_t), crc);
+
+    const StorageChunk chunks[] = {
+        {&magic, sizeof(magic)},
+        {&count, sizeof(count)},
+        {ids.data(), count * sizeof(uint16_t)},
+        {&crc, sizeof(crc)},
+    };
+
+    const size_t expected_size = sizeof(magic) + sizeof(count) + count * sizeof(uint16_t) + sizeof(crc);
+    if (_backend->write(_name, chunks, std::size(chunks), true) != expected_size) {
+        D_PRINTF("KvStore(%s): Unable to write manifest\r\n", _name);
+        return false;
+    }
+
+    return true;
+}
+
+bool KvStore::_replay(KvSegment &segment) {
+    const String key = _segment_key(segment.id);
+    const size_t total = _backend->size(key.c_str());
+
+    // Buffer is empty while loading, so it's used to read records
+    uint8_t *record = _buffer;
+    char record_key[KV_STORE_KEY_SIZE];
+
+    uint32_t position = 0;
+    while (position < total) {
+        if (_backend->read(key.c_str(), position, record, KV_STORE_RECORD_HEADER_SIZE) != KV_STORE_RECORD_HEADER_SIZE) break;
+
+        const auto type = (KvRecordType) record[0];
+        const uint8_t key_length = record[1];
+
+        uint16_t size;
+        memcpy(&size, record + 2, sizeof(size));
+
+        if ((type != KvRecordType::PUT && type != KvRecordType::REMOVE)
+            || key_length == 0 || key_length >= KV_STORE_KEY_SIZE || size > KV_STORE_VALUE_MAX_SIZE) break;
+
+        const size_t record_size = _record_size(key_length, size);
+        const size_t rest_size = record_size - KV_STORE_RECORD_HEADER_SIZE;
+
+        if (position + record_size > total
+            || _backend->read(key.c_str(), position + KV_STORE_RECORD_HEADER_SIZE,
+                              record + KV_STORE_RECORD_HEADER_SIZE, rest_size) != rest_size) break;
+
+        uint32_t crc;
+        memcpy(&crc, record + record_size - sizeof(crc), sizeof(crc));
+
+        if (crc != crc32_calc(record, record_size - sizeof(crc))) break;
+
+        memcpy(record_key, record + KV_STORE_RECORD_HEADER_SIZE, key_length);
+        record_key[key_length] = '\0';
+
+        auto *entry = _find(record_key);
+        if (type == KvRecordType::PUT) {
+            if (entry) {
+                _release(*entry);
+            } else {
+                entry = _insert(record_key);
+            }
+
+            _set_location(*entry, segment.id, position, size);
+        } else {
+            segment.tombstones += record_size;
+
+            if (entry) {
+                _release(*entry);
+                _erase(entry);
+            }
+        }
+
+        position += record_size;
+    }
+
+    // Records after the broken one are garbage
+    segment.size = total;
+
+    if (position != total) {
+        D_PRINTF("KvStore(%s): Segment %u is broken at %u, drop %u bytes\r\n", _name, segment.id, position, total - position);
+        return false;
+    }
+
+    return true;
+}
+
+bool KvStore::_open_segment() {
+    const uint16_t id = _allocate_segment_id();
+
+    // Left from the interrupted compaction, id isn't referenced by the manifest
+    const String key = _segment_key(id);
+    if (_backend->exists(key.c_str())) _backend->remove(key.c_str());
+
+    _segments.push_back({id, 0, 0, 0});
+    if (!_write_manifest()) {
+        _segments.pop_back();
+        return false;
+    }
+
+    VERBOSE(D_PRINTF("KvStore(%s): Opened segment %u\r\n", _name, id));
+    return true;
+}
+
+uint16_t KvStore::_allocate_segment_id() {
+    // Ids wrap around, so skip ids of the live segments. KV_STORE_NIL marks free index slots
+    while (_next_segment_id == KV_STORE_NIL || _get_segment(_next_segment_id)) ++_next_segment_id;
+
+    return _next_segment_id++;
+}
+
+bool KvStore::_move_pending() {
+    const uint16_t old_id = _active().id;
+    const uint32_t old_size = _active().size;
+
+    if (!_open_segment()) return false;
+
+    auto &segment = _active();
+    auto *old_segment = _get_segment(old_id);
+
+    // Pending records have the same layout in the new segment, only the base offset changes
+    for (size_t i = 0; i < _index_capacity; ++i) {
+        auto &entry = _index[i];
+        if (entry.segment != old_id || entry.offset < old_size) continue;
+
+        const size_t record_size = _record_size(strlen(entry.key), entry.size);
+        old_segment->live -= record_size;
+        segment.live += record_size;
+
+        entry.segment = segment.id;
+        entry.offset -= old_size;
+    }
+
+    // Tombstones aren't referenced by the index, so they're found in the buffer itself
+    for (size_t position = 0; position + KV_STORE_RECORD_HEADER_SIZE <= _buffer_size;) {
+        uint16_t size;
+        memcpy(&size, _buffer + position + 2, sizeof(size));
+
+        const size_t record_size = _record_size(_buffer[position + 1], size);
+        if ((KvRecordType) _buffer[position] == KvRecordType::REMOVE) {
+            old_segment->tombstones -= record_size;
+            segment.tombstones += record_size;
+        }
+
+        position += record_size;
+    }
+
+    // Broken tail is counted as garbage
+    old_segment->size = _backend->size(_segment_key(old_id).c_str());
+    _broken = false;
+
+    _schedule_compaction();
+    return true;
+}
+
+uint8_t *KvStore::_reserve(size_t record_size, uint16_t &out_segment, uint32_t &out_offset) {
+    if (_segments.empty() && !_open_segment()) return nullptr;
+    if (_broken && _buffer_size == 0 && !_move_pending()) return nullptr;
+
+    if (_buffer_size + record_size > KV_STORE_BUFFER_SIZE && !flush()) return nullptr;
+
+    if (_active().size + _buffer_size > 0 && _active().size + _buffer_size + record_size > KV_STORE_SEGMENT_SIZE) {
+        if (!flush() || !_open_segment()) return nullptr;
+
+        // Sealed segment could already have enough garbage
+        _schedule_compaction();
+    }
+
+    out_segment = _active().id;
+    out_offset = _active().size + _buffer_size;
+
+    auto *record = _buffer + _buffer_size;
+    _buffer_size += record_size;
+
+    _schedule_flush();
+    return record;
+}
+
+void KvStore::_schedule_flush() {
+    if (_flush_timer_id != TIMER_INVALID_ID) return;
+
+    _flush_timer_id = _timer.add_timeout([this](void *) {
+        _flush_timer_id = TIMER_INVALID_ID;
+        flush();
+    }, KV_STORE_FLUSH_DELAY);
+}
+
+void KvStore::_schedule_compaction() {
+    if (_compact_timer_id != TIMER_INVALID_ID) return;
+
+    bool needed = false;
+    for (size_t i = 0; !needed && i + 1 < _segments.size(); ++i) {
+        needed = _needs_compaction(_segments[i]);
+    }
+
+    if (!needed) return;
+
+    // Single segment per call to keep the loop responsive
+    _compact_timer_id = _timer.add_timeout([this](void *) {
+        _compact_timer_id = TIMER_INVALID_ID;
+
+        for (size_t i = 0; i + 1 < _segments.size(); ++i) {
+            if (!_needs_compaction(_segments[i])) continue;
+
+            if (_compact_segment(_segments[i].id)) _schedule_compaction();
+            break;
+        }
+    }, KV_STORE_COMPACT_DELAY);
+}
+
+size_t KvStore::_live_size(const KvSegment &segment) const {
+    // Nothing is hidden by tombstones of the oldest segment, so they're garbage
+    return segment.live + (segment.id != _segments.front().id ? segment.tombstones : 0);
+}
+
+bool KvStore::_needs_compaction(const KvSegment &segment) const {
+    return (segment.size - _live_size(segment)) * 100 >= (size_t) segment.size * KV_STORE_COMPACT_THRESHOLD;
+}
+
+bool KvStore::_compact_segment(uint16_t id) {
+    const String key = _segment_key(id);
+    const uint32_t total = _get_segment(id)->size;
+
+    // Tombstones are needed only while older segments may contain records of the key
+    const bool has_older = _segments.front().id != id;
+
+    auto *record = new uint8_t[KV_STORE_RECORD_MAX_SIZE];
+    char record_key[KV_STORE_KEY_SIZE];
+
+    bool success = true;
+    size_t moved = 0;
+
+    uint32_t position = 0;
+    while (position < total) {
+        const size_t prefix_size = KV_STORE_RECORD_HEADER_SIZE + KV_STORE_KEY_SIZE - 1;
+        const size_t read = _backend->read(key.c_str(), position, record, std::min<size_t>(prefix_size, total - position));
+
+        if (read < KV_STORE_RECORD_HEADER_SIZE) break;
+
+        const auto type = (KvRecordType) record[0];
+        const uint8_t key_length = record[1];
+
+        uint16_t size;
+        memcpy(&size, record + 2, sizeof(size));
+
+        // Broken tail was already dropped on load
+        const size_t record_size = _record_size(key_length, size);
+        if (key_length == 0 || key_length >= KV_STORE_KEY_SIZE || size > KV_STORE_VALUE_MAX_SIZE
+            || position + record_size > total || read < KV_STORE_RECORD_HEADER_SIZE + key_length) break;
+
+        memcpy(record_key, record + KV_STORE_RECORD_HEADER_SIZE, key_length);
+        record_key[key_length] = '\0';
+
+        auto *entry = _find(record_key);
+        const bool live = type == KvRecordType::PUT
+                          ? entry && entry->segment == id && entry->offset == position
+                          : has_older && !entry;
+
+        if (live) {
+            // Record doesn't depend on its location, so it's copied as is
+            // Prefix of the short record already contains it entirely
+            const size_t rest_size = record_size > read ? record_size - read : 0;
+            uint16_t segment;
+            uint32_t offset;
+
+            if (rest_size > 0 && _backend->read(key.c_str(), position + read, record + read, rest_size) != rest_size) {
+                success = false;
+                break;
+            }
+
+            auto *dst = _reserve(record_size, segment, offset);
+            if (!dst) {
+                success = false;
+                break;
+            }
+
+            memcpy(dst, record, record_size);
+
+            if (entry) {
+                _release(*entry);
+                _set_location(*entry, segment, offset, entry->size);
+            } else {
+                _get_segment(segment)->tombstones += record_size;
+            }
+
+            moved += record_size;
+        }
+
+        position += record_size;
+    }
+
+    delete[] record;
+
+    if (!success || !flush()) {
+        D_PRINTF("KvStore(%s): Compaction of segment %u failed\r\n", _name, id);
+        return false;
+    }
+
+    const auto it = std::find_if(_segments.begin(), _segments.end(), [id](const KvSegment &segment) {
+        return segment.id == id;
+    });
+
+    const KvSegment removed = *it;
+    const auto index = it - _segments.begin();
+
+    _segments.erase(it);
+    if (!_write_manifest()) {
+        _segments.insert(_segments.begin() + index, removed);
+        return false;
+    }
+
+    _backend->remove(key.c_str());
+
+    D_PRINTF("KvStore(%s): Compacted segment %u, moved %u of %u bytes\r\n", _name, id, moved, total);
+    return true;
+}
+
+size_t KvStore::_read_value(const KvIndexEntry &entry, size_t offset, void *data, size_t size) const {
+    const size_t position = entry.offset + KV_STORE_RECORD_HEADER_SIZE + strlen(entry.key) + offset;
+
+    if (_is_pending(entry)) {
+        memcpy(data, _buffer + position - _segments.back().size, size);
+        return size;
+    }
+
+    return _backend->read(_segment_key(entry.segment).c_str(), position, data, size);
+}
+
+bool KvStore::_equals(const KvIndexEntry &entry, const void *data, size_t size) const {
+    if (entry.size != size) return false;
+
+    // Compared by chunks, so there is no need in value sized buffer
+    uint8_t chunk[32];
+    for (size_t offset = 0; offset < size; offset += sizeof(chunk)) {
+        const size_t length = std::min(sizeof(chunk), size - offset);
+        if (_read_value(entry, offset, chunk, length) != length) return false;
+        if (memcmp(chunk, (const uint8_t *) data + offset, length) != 0) return false;
+    }
+
+    return true;
+}
+
+KvIndexEntry *KvStore::_find(const char *key) const {
+    if (!_index || !key) return nullptr;
+
+    const uint32_t hash = _hash(key);
+    const size_t mask = _index_capacity - 1;
+
+    // Index is never full, so probing always reaches a free slot
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        auto &entry = _index[i];
+        if (entry.segment == KV_STORE_NIL) return nullptr;
+        if (entry.hash == hash && strcmp(entry.key, key) == 0) return &entry;
+    }
+}
+
+KvIndexEntry *KvStore::_insert(const char *key) {
+    // Keep load factor under 75%
+    if ((_count + 1) * 4 > _index_capacity * 3) _grow_index();
+
+    const uint32_t hash = _hash(key);
+    const size_t mask = _index_capacity - 1;
+
+    size_t i = hash & mask;
+    while (_index[i].segment != KV_STORE_NIL) i = (i + 1) & mask;
+
+    auto &entry = _index[i];
+    strncpy(entry.key, key, sizeof(entry.key) - 1);
+    entry.key[sizeof(entry.key) - 1] = '\0';
+    entry.hash = hash;
+
+    _count++;
+    return &entry;
+}
+
+void KvStore::_erase(KvIndexEntry *entry) {
+    const size_t mask = _index_capacity - 1;
+
+    size_t i = entry - _index;
+    _index[i].segment = KV_STORE_NIL;
+    _count--;
+
+    // Backward shift, so probe sequences stay unbroken without tombstones
+    for (size_t j = (i + 1) & mask; _index[j].segment != KV_STORE_NIL; j = (j + 1) & mask) {
+        const size_t home = _index[j].hash & mask;
+
+        // Entry can't be moved before its home slot
+        const bool between = i <= j ? (home > i && home <= j) : (home > i || home <= j);
+        if (between) continue;
+
+        _index[i] = _index[j];
+        _index[j].segment = KV_STORE_NIL;
+        i = j;
+    }
+}
+
+void KvStore::_grow_index() {
+    auto *old_index = _index;
+    const size_t old_capacity = _index_capacity;
+
+    _index_capacity *= 2;
+    _index = new KvIndexEntry[_index_capacity];
+
+    const size_t mask = _index_capacity - 1;
+    for (size_t k = 0; k < old_capacity; ++k) {
+        if (old_index[k].segment == KV_STORE_NIL) continue;
+
+        size_t i = old_index[k].hash & mask;
+        while (_index[i].segment != KV_STORE_NIL) i = (i + 1) & mask;
+
+        _index[i] = old_index[k];
+    }
+
+    delete[] old_index;
+
+    VERBOSE(D_PRINTF("KvStore(%s): Index capacity grown to %u\r\n", _name, _index_capacity));
+}
+
+void KvStore::_set_location(KvIndexEntry &entry, uint16_t segment, uint32_t offset, uint16_t size) {
+    entry.segment = segment;
+    entry.offset = offset;
+    entry.size = size;
+
+    if (auto *s = _get_segment(segment)) s->live += _record_size(strlen(entry.key), size);
+}
+
+void KvStore::_release(const KvIndexEntry &entry) {
+    if (auto *s = _get_segment(entry.segment)) s->live -= _record_size(strlen(entry.key), entry.size);
+}
+
+size_t KvStore::_record_size(size_t key_length, size_t size) {
+    return KV_STORE_RECORD_HEADER_SIZE + key_length + size + sizeof(uint32_t);
+}
+
+void KvStore::_fill_record(uint8_t *record, KvRecordType type, const char *key, size_t key_length,
+                           const void *data, size_t size) {
+    const auto value_size = (uint16_t) size;
+    const size_t record_size = _record_size(key_length, size);
+
+    record[0] = (uint8_t) type;
+    record[1] = (uint8_t) key_length;
+    memcpy(record + 2, &value_size, sizeof(value_size));
+    memcpy(record + KV_STORE_RECORD_HEADER_SIZE, key, key_length);
+    if (size > 0) memcpy(record + KV_STORE_RECORD_HEADER_SIZE + key_length, data, size);
+
+    const uint32_t crc = crc32_calc(record, record_size - sizeof(crc));
+    memcpy(record + record_size - sizeof(crc), &crc, sizeof(crc));
+}
+
+uint32_t KvStore::_hash(const char *key) {
+    // FNV-1a
+    uint32_t hash = 0x811c9dc5;
+    for (; *key; ++key) {
+        hash ^= (uint8_t) *key;
+        hash *= 0x01000193;
+    }
+
+    return hash;
+}
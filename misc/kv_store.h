@@ -0,0 +1,204 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "./storage_fs_backend.h"
+#include "./timer.h"
+#include "../utils/enum.h"
+
+#ifndef KV_STORE_KEY_SIZE
+#define KV_STORE_KEY_SIZE                       (16u)                   // Including null terminator
+#endif
+#ifndef KV_STORE_VALUE_MAX_SIZE
+#define KV_STORE_VALUE_MAX_SIZE                 (256u)
+#endif
+#ifndef KV_STORE_BUFFER_SIZE
+#define KV_STORE_BUFFER_SIZE                    (512u)                  // Pending records are appended to the segment at once
+#endif
+#ifndef KV_STORE_SEGMENT_SIZE
+#define KV_STORE_SEGMENT_SIZE                   (4096u)                 // New segment is started when active one exceeds this size
+#endif
+#ifndef KV_STORE_FLUSH_DELAY
+#define KV_STORE_FLUSH_DELAY                    (1000u)                 // Wait for more changes before writing pending records
+#endif
+#ifndef KV_STORE_COMPACT_DELAY
+#define KV_STORE_COMPACT_DELAY                  (5000u)
+#endif
+#ifndef KV_STORE_COMPACT_THRESHOLD
+#define KV_STORE_COMPACT_THRESHOLD              (50u)                   // Percent of garbage in the segment to compact it
+#endif
+#ifndef KV_STORE_INDEX_CAPACITY
+#define KV_STORE_INDEX_CAPACITY                 (16u)                   // Initial capacity of the index, must be power of 2
+#endif
+
+constexpr uint16_t KV_STORE_NIL = 0xffff;
+constexpr uint32_t KV_STORE_MAGIC = 0x4b565331;
+
+// Record: [type] [key length] [value size] [key] [value] [crc]
+constexpr size_t KV_STORE_RECORD_HEADER_SIZE = sizeof(uint8_t) + sizeof(uint8_t) + sizeof(uint16_t);
+constexpr size_t KV_STORE_RECORD_MAX_SIZE = KV_STORE_RECORD_HEADER_SIZE + KV_STORE_KEY_SIZE + KV_STORE_VALUE_MAX_SIZE + sizeof(uint32_t);
+
+static_assert(KV_STORE_KEY_SIZE >= 2 && KV_STORE_KEY_SIZE <= 256, "Unsupported KV_STORE_KEY_SIZE value");
+static_assert(KV_STORE_VALUE_MAX_SIZE <= UINT16_MAX, "Unsupported KV_STORE_VALUE_MAX_SIZE value");
+static_assert(KV_STORE_BUFFER_SIZE >= KV_STORE_RECORD_MAX_SIZE, "KV_STORE_BUFFER_SIZE must fit the largest record");
+static_assert((KV_STORE_INDEX_CAPACITY & (KV_STORE_INDEX_CAPACITY - 1)) == 0, "KV_STORE_INDEX_CAPACITY must be power of 2");
+
+// Non-zero values, so zero-filled space is never read as a valid record
+MAKE_ENUM(KvRecordType, uint8_t,
+    PUT, 1,
+    REMOVE, 2,
+)
+
+struct KvSegment {
+    uint16_t id;
+    uint32_t size;                  // Bytes written to the backend
+    uint32_t live;                  // Bytes of records which are still referenced by the index
+    uint32_t tombstones;            // Bytes of removal records, needed while older segments exist
+};
+
+struct KvIndexEntry {
+    char key[KV_STORE_KEY_SIZE];
+    uint32_t hash;
+    uint32_t offset;
+    uint16_t segment = KV_STORE_NIL;    // KV_STORE_NIL for the free slot
+    uint16_t size;
+};
+
+/**
+ * Log-structured key-value store for many small records.
+ *
+ * Records are appended to segments named "<name>.<id>", list of segments is kept in "<name>".
+ * Changes are collected in RAM and appended to the active segment in a single write after KV_STORE_FLUSH_DELAY,
+ * when the buffer is full or on flush(). Removal appends a tombstone.
+ *
+ * All keys are kept in RAM in the open-addressing hash index along with the record location,
+ * so lookup never touches the backend and get() is a single read.
+ * Segments which are mostly garbage are compacted: live records are copied to the active segment
+ * and the old segment is removed.
+ *
+ * Interrupted append is detected by the record checksum on load, the rest of the segment is dropped.
+ */
+class KvStore {
+    Timer &_timer;
+    const char *_name;
+
+    StorageBackend *_backend = nullptr;
+    std::unique_ptr<StorageFsBackend> _fs_backend;
+
+    // Ordered from the oldest to the newest, the last one is active
+    std::vector<KvSegment> _segments;
+    uint16_t _next_segment_id = 0;
+
+    KvIndexEntry *_index = nullptr;
+    size_t _index_capacity = 0;
+    size_t _count = 0;
+
+    // Records of the active segment which aren't written yet
+    uint8_t _buffer[KV_STORE_BUFFER_SIZE];
+    size_t _buffer_size = 0;
+
+    // Append to the active segment failed, so its tail can't be extended anymore
+    bool _broken = false;
+
+    TimerId _flush_timer_id = TIMER_INVALID_ID;
+    TimerId _compact_timer_id = TIMER_INVALID_ID;
+
+public:
+    KvStore(Timer &timer, const char *name);
+    ~KvStore();
+
+    KvStore(const KvStore &) = delete;
+    KvStore &operator=(const KvStore &) = delete;
+
+    // Files under STORAGE_PATH of the filesystem
+    bool begin(FS *fs);
+
+    // Backend isn't owned by the store and must support appends
+    bool begin(StorageBackend *backend);
+
+    // Key must be shorter than KV_STORE_KEY_SIZE, size must not exceed KV_STORE_VALUE_MAX_SIZE
+    bool put(const char *key, const void *data, size_t size);
+
+    // Returns value size or 0 if key doesn't exist. Value is truncated to the buffer size
+    size_t get(const char *key, void *data, size_t size) const;
+
+    bool remove(const char *key);
+
+    template<typename T, typename = std::enable_if_t<std::is_standard_layout_v<T>>>
+    inline bool put(const char *key, const T &value) { return put(key, &value, sizeof(T)); }
+
+    template<typename T, typename = std::enable_if_t<std::is_standard_layout_v<T>>>
+    inline bool get(const char *key, T &value) const { return get(key, &value, sizeof(T)) == sizeof(T); }
+
+    [[nodiscard]] inline bool contains(const char *key) const { return _find(key) != nullptr; }
+    [[nodiscard]] size_t value_size(const char *key) const;
+
+    [[nodiscard]] inline size_t count() const { return _count; }
+    [[nodiscard]] inline const char *name() const { return _name; }
+
+    // Bytes occupied by segments including pending records
+    [[nodiscard]] size_t storage_size() const;
+
+    // Bytes of records which are overwritten or removed
+    [[nodiscard]] size_t garbage_size() const;
+
+    // Call fn(const char *key, size_t size) for every key. Store mustn't be modified during the iteration
+    template<typename Fn>
+    void for_each(Fn fn) const;
+
+    // Write pending records immediately
+    bool flush();
+
+    // Compact all segments exceeding KV_STORE_COMPACT_THRESHOLD. Returns number of compacted segments
+    size_t compact();
+
+private:
+    [[nodiscard]] inline String _segment_key(uint16_t id) const { return String(_name) + "." + String(id); }
+    [[nodiscard]] inline KvSegment &_active() { return _segments.back(); }
+
+    [[nodiscard]] KvSegment *_get_segment(uint16_t id);
+    [[nodiscard]] bool _is_pending(const KvIndexEntry &entry) const;
+
+    bool _load_manifest();
+    bool _write_manifest();
+    bool _replay(KvSegment &segment);
+    bool _open_segment();
+    uint16_t _allocate_segment_id();
+    bool _move_pending();
+
+    uint8_t *_reserve(size_t record_size, uint16_t &out_segment, uint32_t &out_offset);
+    void _schedule_flush();
+
+    void _schedule_compaction();
+    [[nodiscard]] size_t _live_size(const KvSegment &segment) const;
+    [[nodiscard]] bool _needs_compaction(const KvSegment &segment) const;
+    bool _compact_segment(uint16_t id);
+
+    size_t _read_value(const KvIndexEntry &entry, size_t offset, void *data, size_t size) const;
+    [[nodiscard]] bool _equals(const KvIndexEntry &entry, const void *data, size_t size) const;
+
+    [[nodiscard]] KvIndexEntry *_find(const char *key) const;
+    KvIndexEntry *_insert(const char *key);
+    void _erase(KvIndexEntry *entry);
+    void _grow_index();
+
+    void _set_location(KvIndexEntry &entry, uint16_t segment, uint32_t offset, uint16_t size);
+    void _release(const KvIndexEntry &entry);
+
+    [[nodiscard]] static size_t _record_size(size_t key_length, size_t size);
+    static void _fill_record(uint8_t *record, KvRecordType type, const char *key, size_t key_length,
+                             const void *data, size_t size);
+    [[nodiscard]] static uint32_t _hash(const char *key);
+};
+
+template<typename Fn>
+void KvStore::for_each(Fn fn) const {
+    for (size_t i = 0; i < _index_capacity; ++i) {
+        const auto &entry = _index[i];
+        if (entry.segment != KV_STORE_NIL) fn((const char *) entry.key, (size_t) entry.size);
+    }
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+#include "../debug.h"
+
+/**
+ * Bounded lock-free multi-producer single-consumer queue.
+ *
+ * push() can be called from any task or ISR, it never blocks and fails if the queue is full.
+ * pop() should be called from a single consumer only.
+ * Items are constructed in place, so queue doesn't allocate memory.
+ */
+template<typename T, size_t Size>
+class MpscQueue {
+    static_assert(Size >= 2 && (Size & (Size - 1)) == 0, "Size should be a power of two");
+
+    struct Cell {
+        std::atomic<size_t> sequence;
+        alignas(T) uint8_t storage[sizeof(T)];
+    };
+
+    Cell _cells[Size];
+
+    std::atomic<size_t> _enqueue_pos{0};
+    size_t _dequeue_pos = 0;
+
+public:
+    MpscQueue();
+    ~MpscQueue();
+
+    MpscQueue(const MpscQueue &) = delete;
+    MpscQueue &operator=(const MpscQueue &) = delete;
+
+    [[nodiscard]] inline size_t size() const { return Size; }
+
+    template<typename... Args>
+    bool push(Args &&... args);
+
+    bool pop(T &out);
+};
+
+template<typename T, size_t Size>
+MpscQueue<T, Size>::MpscQueue() {
+    for (size_t i = 0; i < Size; ++i) {
+        _cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+template<typename T, size_t Size>
+MpscQueue<T, Size>::~MpscQueue() {
+    while (true) {
+        auto &cell = _cells[_dequeue_pos & (Size - 1)];
+        if (cell.sequence.load(std::memory_order_acquire) != _dequeue_pos + 1) break;
+
+        ((T *) cell.storage)->~T();
+        _dequeue_pos++;
+    }
+}
+
+template<typename T, size_t Size>
+template<typename... Args>
+bool MpscQueue<T, Size>::push(Args &&... args) {
+    auto pos = _enqueue_pos.load(std::memory_order_relaxed);
+
+    Cell *cell;
+    while (true) {
+        cell = &_cells[pos & (Size - 1)];
+
+        const auto sequence = cell->sequence.load(std::memory_order_acquire);
+        const auto diff = (intptr_t) sequence - (intptr_t) pos;
+
+        if (diff == 0) {
+            if (_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (diff < 0) {
+            VERBOSE(D_PRINT("MpscQueue: queue is full"));
+            return false;
+        } else {
+            pos = _enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    new(cell->storage) T(std::forward<Args>(args)...);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+
+    return true;
+}
+
+template<typename T, size_t Size>
+bool MpscQueue<T, Size>::pop(T &out) {
+    auto &cell = _cells[_dequeue_pos & (Size - 1)];
+
+    // Producer may be still writing the item, it will be available on the next call
+    if (cell.sequence.load(std::memory_order_acquire) != _dequeue_pos + 1) return false;
+
+    auto *item = (T *) cell.storage;
+    out = std::move(*item);
+    item->~T();
+
+    cell.sequence.store(_dequeue_pos + Size, std::memory_order_release);
+    _dequeue_pos++;
+
+    return true;
+}
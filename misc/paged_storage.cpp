@@ -0,0 +1,291 @@
+#include "./paged_storage.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "../debug.h"
+
+PagedStorage::PagedStorage(Timer &timer, const char *key, size_t size, size_t page_size, size_t cache_size) :
+    _timer(timer), _key(key), _size(size), _page_size(std::max<size_t>(page_size, 1)), _cache_size(cache_size) {}
+
+PagedStorage::~PagedStorage() {
+    flush();
+    if (_flush_timer_id != TIMER_INVALID_ID) _timer.clear_timeout(_flush_timer_id);
+
+    delete[] _cache;
+    delete[] _slots;
+}
+
+bool PagedStorage::begin(FS *fs) {
+    _fs_backend = std::make_unique<StorageFsBackend>(fs);
+    return begin(_fs_backend.get());
+}
+
+bool PagedStorage::begin(StorageBackend *backend) {
+    _backend = backend;
+    _read_only = !_backend->supports_partial_write();
+
+    const size_t stored_size = _backend->exists(_key) ? _backend->size(_key) : 0;
+    if (_size == 0) _size = stored_size;
+
+    if (_size == 0) {
+        D_PRINTF("PagedStorage(%s): Value doesn't exist and size isn't specified\r\n", _key);
+
+        _backend = nullptr;
+        return false;
+    }
+
+    if (stored_size != _size) {
+        D_PRINTF("PagedStorage(%s): Size doesn't match, expected %u, got %u. Reset value...\r\n", _key, _size, stored_size);
+
+        if (!_create()) {
+            _backend = nullptr;
+            return false;
+        }
+    }
+
+    // Cache never exceeds the blob itself
+    const size_t pages = std::min(std::max<size_t>(_cache_size / _page_size, 1), page_count());
+    _slot_count = (uint16_t) std::min<size_t>(pages, PAGED_STORAGE_NIL - 1);
+
+    delete[] _cache;
+    delete[] _slots;
+
+    _cache = new uint8_t[(size_t) _slot_count * _page_size];
+    _slots = new PagedStorageSlot[_slot_count];
+
+    // Free slots are at the tail, so they're used before evicting anything
+    _head = _tail = PAGED_STORAGE_NIL;
+    for (uint16_t slot = 0; slot < _slot_count; ++slot) _push_front(slot);
+
+    D_PRINTF("PagedStorage(%s): Size %u, %u pages, cache %u pages%s\r\n",
+             _key, _size, page_count(), _slot_count, _read_only ? ", read-only" : "");
+
+    return true;
+}
+
+size_t PagedStorage::read(size_t offset, void *data, size_t size) {
+    if (!_backend || !_slots || offset >= _size) return 0;
+
+    size = std::min(size, _size - offset);
+
+    size_t result = 0;
+    while (result < size) {
+        const auto page = (uint32_t) (offset / _page_size);
+        const size_t page_offset = offset % _page_size;
+        const size_t length = std::min(size - result, _page_length(page) - page_offset);
+
+        const uint8_t *ptr = _acquire(page, false);
+        if (!ptr) break;
+
+        memcpy((uint8_t *) data + result, ptr + page_offset, length);
+
+        result += length;
+        offset += length;
+    }
+
+    return result;
+}
+
+size_t PagedStorage::write(size_t offset, const void *data, size_t size) {
+    if (!_backend || !_slots || offset >= _size) return 0;
+
+    if (_read_only) {
+        D_PRINTF("PagedStorage(%s): Backend doesn't support partial writes, value is read-only\r\n", _key);
+        return 0;
+    }
+
+    size = std::min(size, _size - offset);
+
+    size_t result = 0;
+    while (result < size) {
+        const auto page = (uint32_t) (offset / _page_size);
+        const size_t page_offset = offset % _page_size;
+        const size_t length = std::min(size - result, _page_length(page) - page_offset);
+
+        uint8_t *ptr = _acquire(page, true);
+        if (!ptr) break;
+
+        memcpy(ptr + page_offset, (const uint8_t *) data + result, length);
+
+        result += length;
+        offset += length;
+    }
+
+    if (_dirty_count > 0) _schedule_flush();
+    return result;
+}
+
+bool PagedStorage::flush() {
+    if (_flush_timer_id != TIMER_INVALID_ID) {
+        _timer.clear_timeout(_flush_timer_id);
+        _flush_timer_id = TIMER_INVALID_ID;
+    }
+
+    if (!_backend || !_slots || _dirty_count == 0) return true;
+
+    std::vector<uint16_t> dirty;
+    dirty.reserve(_dirty_count);
+
+    for (uint16_t slot = 0; slot < _slot_count; ++slot) {
+        if (_slots[slot].dirty) dirty.push_back(slot);
+    }
+
+    std::sort(dirty.begin(), dirty.end(), [this](uint16_t a, uint16_t b) { return _slots[a].page < _slots[b].page; });
+
+    bool success = true;
+    StorageChunk chunks[PAGED_STORAGE_FLUSH_CHUNKS];
+
+    for (size_t i = 0; i < dirty.size();) {
+        // Group adjacent pages into a single partial write
+        const uint32_t first_page = _slots[dirty[i]].page;
+
+        size_t count = 0;
+        size_t expected_size = 0;
+
+        while (i + count < dirty.size() && count < PAGED_STORAGE_FLUSH_CHUNKS
+               && _slots[dirty[i + count]].page == first_page + count) {
+            const uint16_t slot = dirty[i + count];
+            const size_t length = _page_length(_slots[slot].page);
+
+            chunks[count++] = {_slot_data(slot), length};
+            expected_size += length;
+        }
+
+        const size_t written = _backend->write_at(_key, (size_t) first_page * _page_size, chunks, count);
+        if (written == expected_size) {
+            for (size_t k = 0; k < count; ++k) _slots[dirty[i + k]].dirty = false;
+
+            _dirty_count -= count;
+            _stats.writebacks += count;
+        } else {
+            D_PRINTF("PagedStorage(%s): Unable to write pages %u-%u\r\n", _key, first_page, first_page + count - 1);
+            success = false;
+        }
+
+        i += count;
+    }
+
+    if (!success) _schedule_flush();
+    return success;
+}
+
+size_t PagedStorage::_page_length(uint32_t page) const {
+    const size_t offset = (size_t) page * _page_size;
+    return std::min(_page_size, _size - offset);
+}
+
+bool PagedStorage::_create() {
+    if (!_backend->supports_append()) {
+        D_PRINTF("PagedStorage(%s): Backend doesn't support appends, unable to create value\r\n", _key);
+        return false;
+    }
+
+    // Value is created page by page to avoid allocating the whole blob
+    auto *zero = new uint8_t[_page_size];
+    memset(zero, 0, _page_size);
+
+    bool success = true;
+    for (uint32_t page = 0; success && page < page_count(); ++page) {
+        const StorageChunk chunk{zero, _page_length(page)};
+        const size_t written = page == 0 ? _backend->write(_key, &chunk, 1) : _backend->append(_key, &chunk, 1);
+
+        success = written == chunk.size;
+    }
+
+    delete[] zero;
+
+    if (!success) D_PRINTF("PagedStorage(%s): Unable to create value\r\n", _key);
+    return success;
+}
+
+uint8_t *PagedStorage::_acquire(uint32_t page, bool dirty) {
+    uint16_t slot = _head;
+    while (slot != PAGED_STORAGE_NIL && _slots[slot].page != page) slot = _slots[slot].next;
+
+    if (slot != PAGED_STORAGE_NIL) {
+        _stats.hits++;
+    } else {
+        _stats.misses++;
+
+        slot = _tail;
+        if (_slots[slot].page != PAGED_STORAGE_NO_PAGE) {
+            if (_slots[slot].dirty && !_write_back(slot)) return nullptr;
+
+            _stats.evictions++;
+        }
+
+        const size_t length = _page_length(page);
+        if (_backend->read(_key, (size_t) page * _page_size, _slot_data(slot), length) != length) {
+            D_PRINTF("PagedStorage(%s): Unable to read page %u\r\n", _key, page);
+
+            _slots[slot].page = PAGED_STORAGE_NO_PAGE;
+            return nullptr;
+        }
+
+        _slots[slot].page = page;
+    }
+
+    if (dirty && !_slots[slot].dirty) {
+        _slots[slot].dirty = true;
+        _dirty_count++;
+    }
+
+    if (slot != _head) {
+        _unlink(slot);
+        _push_front(slot);
+    }
+
+    return _slot_data(slot);
+}
+
+bool PagedStorage::_write_back(uint16_t slot) {
+    auto &entry = _slots[slot];
+
+    const StorageChunk chunk{_slot_data(slot), _page_length(entry.page)};
+    if (_backend->write_at(_key, (size_t) entry.page * _page_size, &chunk, 1) != chunk.size) {
+        D_PRINTF("PagedStorage(%s): Unable to write page %u\r\n", _key, entry.page);
+        return false;
+    }
+
+    entry.dirty = false;
+
+    _dirty_count--;
+    _stats.writebacks++;
+
+    return true;
+}
+
+void PagedStorage::_unlink(uint16_t slot) {
+    auto &entry = _slots[slot];
+
+    if (entry.prev != PAGED_STORAGE_NIL) _slots[entry.prev].next = entry.next;
+    else _head = entry.next;
+
+    if (entry.next != PAGED_STORAGE_NIL) _slots[entry.next].prev = entry.prev;
+    else _tail = entry.prev;
+
+    entry.prev = entry.next = PAGED_STORAGE_NIL;
+}
+
+void PagedStorage::_push_front(uint16_t slot) {
+    auto &entry = _slots[slot];
+
+    entry.prev = PAGED_STORAGE_NIL;
+    entry.next = _head;
+
+    if (_head != PAGED_STORAGE_NIL) _slots[_head].prev = slot;
+    _head = slot;
+
+    if (_tail == PAGED_STORAGE_NIL) _tail = slot;
+}
+
+void PagedStorage::_schedule_flush() {
+    if (_flush_timer_id != TIMER_INVALID_ID) return;
+
+    _flush_timer_id = _timer.add_timeout([this](void *) {
+        _flush_timer_id = TIMER_INVALID_ID;
+        flush();
+    }, PAGED_STORAGE_FLUSH_DELAY);
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+
+#include "./storage_fs_backend.h"
+#include "./timer.h"
+
+#ifndef PAGED_STORAGE_PAGE_SIZE
+#define PAGED_STORAGE_PAGE_SIZE                 (256u)
+#endif
+#ifndef PAGED_STORAGE_CACHE_SIZE
+#define PAGED_STORAGE_CACHE_SIZE                (4096u)                 // RAM budget of the page cache
+#endif
+#ifndef PAGED_STORAGE_FLUSH_DELAY
+#define PAGED_STORAGE_FLUSH_DELAY               (60000u)                // Wait before writing dirty pages
+#endif
+#ifndef PAGED_STORAGE_FLUSH_CHUNKS
+#define PAGED_STORAGE_FLUSH_CHUNKS              (8u)                    // Max adjacent dirty pages written at once
+#endif
+
+constexpr uint16_t PAGED_STORAGE_NIL = 0xffff;
+constexpr uint32_t PAGED_STORAGE_NO_PAGE = ~(uint32_t) 0;
+
+struct PagedStorageStats {
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    uint32_t evictions = 0;
+    uint32_t writebacks = 0;            // Pages written to the backend
+};
+
+struct PagedStorageSlot {
+    uint32_t page = PAGED_STORAGE_NO_PAGE;
+    bool dirty = false;
+
+    // Cache slots are linked from the most to the least recently used
+    uint16_t prev = PAGED_STORAGE_NIL;
+    uint16_t next = PAGED_STORAGE_NIL;
+};
+
+/**
+ * Large blob which is loaded by fixed-size pages on the first access.
+ *
+ * Pages are kept in the LRU cache limited by cache_size bytes, so RAM usage doesn't depend on the blob size.
+ * Changed pages are written back on eviction, PAGED_STORAGE_FLUSH_DELAY after the first change or on flush().
+ * Adjacent dirty pages are written by a single partial write.
+ *
+ * Value is stored as is, without header, so it can be uploaded to the filesystem directly.
+ * Blob is read-only if backend doesn't support partial writes.
+ */
+class PagedStorage {
+    Timer &_timer;
+    const char *_key;
+
+    size_t _size;
+    size_t _page_size;
+    size_t _cache_size;
+
+    StorageBackend *_backend = nullptr;
+    std::unique_ptr<StorageFsBackend> _fs_backend;
+    bool _read_only = false;
+
+    uint8_t *_cache = nullptr;
+    PagedStorageSlot *_slots = nullptr;
+    uint16_t _slot_count = 0;
+
+    uint16_t _head = PAGED_STORAGE_NIL;
+    uint16_t _tail = PAGED_STORAGE_NIL;
+
+    size_t _dirty_count = 0;
+    PagedStorageStats _stats{};
+
+    TimerId _flush_timer_id = TIMER_INVALID_ID;
+
+public:
+    /**
+     * @param size blob size, 0 to use size of the existing value.
+     *      Missing value or value of the other size is replaced with zero-filled one.
+     */
+    PagedStorage(Timer &timer, const char *key, size_t size = 0,
+                 size_t page_size = PAGED_STORAGE_PAGE_SIZE, size_t cache_size = PAGED_STORAGE_CACHE_SIZE);
+    ~PagedStorage();
+
+    PagedStorage(const PagedStorage &) = delete;
+    PagedStorage &operator=(const PagedStorage &) = delete;
+
+    // Files under STORAGE_PATH of the filesystem
+    bool begin(FS *fs);
+
+    // Backend isn't owned by the storage
+    bool begin(StorageBackend *backend);
+
+    // Returns number of read bytes
+    size_t read(size_t offset, void *data, size_t size);
+
+    // Returns number of written bytes
+    size_t write(size_t offset, const void *data, size_t size);
+
+    template<typename T, typename = std::enable_if_t<std::is_standard_layout_v<T>>>
+    inline bool get(size_t index, T &value) { return read(index * sizeof(T), &value, sizeof(T)) == sizeof(T); }
+
+    template<typename T, typename = std::enable_if_t<std::is_standard_layout_v<T>>>
+    inline bool set(size_t index, const T &value) { return write(index * sizeof(T), &value, sizeof(T)) == sizeof(T); }
+
+    // Write dirty pages immediately
+    bool flush();
+
+    [[nodiscard]] inline size_t size() const { return _size; }
+    [[nodiscard]] inline size_t page_size() const { return _page_size; }
+    [[nodiscard]] inline size_t page_count() const { return (_size + _page_size - 1) / _page_size; }
+    [[nodiscard]] inline size_t cache_pages() const { return _slot_count; }
+
+    [[nodiscard]] inline const char *key() const { return _key; }
+    [[nodiscard]] inline bool is_read_only() const { return _read_only; }
+    [[nodiscard]] inline bool is_dirty() const { return _dirty_count > 0; }
+
+    [[nodiscard]] inline const PagedStorageStats &stats() const { return _stats; }
+
+private:
+    [[nodiscard]] inline uint8_t *_slot_data(uint16_t slot) const { return _cache + (size_t) slot * _page_size; }
+    [[nodiscard]] size_t _page_length(uint32_t page) const;
+
+    bool _create();
+
+    uint8_t *_acquire(uint32_t page, bool dirty);
+    bool _write_back(uint16_t slot);
+
+    void _unlink(uint16_t slot);
+    void _push_front(uint16_t slot);
+
+    void _schedule_flush();
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "./vector.h"
+
+/**
+ * Allocator with the inline buffer for N items.
+ * Buffer belongs to the vector, so it's never copied with the allocator.
+ */
+template<typename T, uint32_t N>
+struct SmallVectorStorage : VectorHeapAllocator {
+    static constexpr size_t inline_size = sizeof(T) * N;
+
+    SmallVectorStorage() = default;
+    SmallVectorStorage(const SmallVectorStorage &) {}
+    SmallVectorStorage &operator=(const SmallVectorStorage &) { return *this; }
+
+    uint8_t *inline_data() { return _buffer; }
+
+private:
+    alignas(T) uint8_t _buffer[sizeof(T) * N];
+};
+
+/**
+ * Vector which stores up to N items without heap allocation and spills to the heap beyond that.
+ * Moving inline items costs N move constructions instead of a pointer swap.
+ */
+template<typename T, uint32_t N, typename GrowthPolicy = VectorGeometricGrowth>
+using SmallVector = Vector<T, GrowthPolicy, SmallVectorStorage<T, N>>;
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "../debug.h"
+
+/**
+ * Lock-free single-producer single-consumer variant of the CircularBuffer.
+ *
+ * Producer fills slot returned by acquire() and publishes it with commit(),
+ * consumer reads slot returned by peek() and returns it with release().
+ * Slot stays owned by one side until commit() / release(), so both sides work in place without copying.
+ * Every call is wait-free, so it's safe to use from network callbacks running on the other task.
+ */
+template<typename T, size_t Size, typename = std::enable_if_t<std::is_standard_layout_v<T>>>
+class SpscCircularBuffer {
+    static_assert(Size > 0, "Size should be greater than zero");
+
+    // One slot is always empty to distinguish full buffer from the empty one
+    static constexpr size_t Capacity = Size + 1;
+
+    T _buffer[Capacity] = {};
+
+    std::atomic<size_t> _head{0}; // Written by producer only
+    std::atomic<size_t> _tail{0}; // Written by consumer only
+
+public:
+    SpscCircularBuffer() = default;
+
+    SpscCircularBuffer(const SpscCircularBuffer &) = delete;
+    SpscCircularBuffer &operator=(const SpscCircularBuffer &) = delete;
+
+    [[nodiscard]] inline size_t size() const { return Size; }
+
+    // Approximate when called concurrently
+    [[nodiscard]] size_t used() const;
+
+    // Producer side
+
+    [[nodiscard]] inline bool can_acquire() const {
+        return _next(_head.load(std::memory_order_relaxed)) != _tail.load(std::memory_order_acquire);
+    }
+
+    // Returns the same slot until commit()
+    T *acquire();
+    void commit();
+
+    // Consumer side
+
+    [[nodiscard]] inline bool can_peek() const {
+        return _tail.load(std::memory_order_relaxed) != _head.load(std::memory_order_acquire);
+    }
+
+    // Returns the oldest committed slot, the same until release()
+    T *peek();
+    void release();
+
+private:
+    static constexpr size_t _next(size_t index) { return index + 1 < Capacity ? index + 1 : 0; }
+};
+
+template<typename T, size_t Size, typename S1>
+size_t SpscCircularBuffer<T, Size, S1>::used() const {
+    const auto head = _head.load(std::memory_order_acquire);
+    const auto tail = _tail.load(std::memory_order_acquire);
+
+    return (Capacity + head - tail) % Capacity;
+}
+
+template<typename T, size_t Size, typename S1>
+T *SpscCircularBuffer<T, Size, S1>::acquire() {
+    const auto head = _head.load(std::memory_order_relaxed);
+    if (_next(head) == _tail.load(std::memory_order_acquire)) return nullptr;
+
+    VERBOSE(D_PRINTF("SpscCircularBuffer: Acquire value at %u\r\n", head));
+    return &_buffer[head];
+}
+
+template<typename T, size_t Size, typename S1>
+void SpscCircularBuffer<T, Size, S1>::commit() {
+    const auto head = _head.load(std::memory_order_relaxed);
+
+    // Release order makes slot content visible before the new head
+    _head.store(_next(head), std::memory_order_release);
+}
+
+template<typename T, size_t Size, typename S1>
+T *SpscCircularBuffer<T, Size, S1>::peek() {
+    const auto tail = _tail.load(std::memory_order_relaxed);
+    if (tail == _head.load(std::memory_order_acquire)) return nullptr;
+
+    VERBOSE(D_PRINTF("SpscCircularBuffer: Peek value at %u\r\n", tail));
+    return &_buffer[tail];
+}
+
+template<typename T, size_t Size, typename S1>
+void SpscCircularBuffer<T, Size, S1>::release() {
+    const auto tail = _tail.load(std::memory_order_relaxed);
+    if (tail == _head.load(std::memory_order_acquire)) return;
+
+    _tail.store(_next(tail), std::memory_order_release);
+}
@@ -1,21 +1,165 @@
 #pragma once
 
+#include <cstring>
+#include <memory>
 #include <type_traits>
 #include <FS.h>
 
+#include "./storage_fs_backend.h"
+#include "./storage_policy.h"
 #include "./timer.h"
 #include "../debug.h"
+#include "../utils/crc.h"
+#include "../utils/enum.h"
 
-#ifndef STORAGE_PATH
-#define STORAGE_PATH                            ("/__storage/")
+#ifdef ARDUINO_ARCH_ESP32
+#include <atomic>
+
+#include "../async/dispatcher.h"
+#include "../async/promise.h"
 #endif
+
 #ifndef STORAGE_SAVE_INTERVAL
 #define STORAGE_SAVE_INTERVAL                   (60000u)                // Wait before commit settings to FLASH
 #endif
+#ifndef STORAGE_SAVE_MAX_DELAY
+#define STORAGE_SAVE_MAX_DELAY                  (300000u)               // Max wait of StorageManager commit while changes keep coming
+#endif
+#ifndef STORAGE_SAVE_SLACK
+#define STORAGE_SAVE_SLACK                      (5000u)                 // Allowed commit delay to group it with other timers
+#endif
+#ifndef STORAGE_JOURNAL_SUFFIX
+#define STORAGE_JOURNAL_SUFFIX                  (".j")
+#endif
+#ifndef STORAGE_JOURNAL_MAX_SIZE
+#define STORAGE_JOURNAL_MAX_SIZE                (1024u)                 // Journal size which triggers compaction
+#endif
+#ifndef STORAGE_JOURNAL_COMPACT_DELAY
+#define STORAGE_JOURNAL_COMPACT_DELAY           (1000u)                 // Wait before fold journal into the data file
+#endif
+#ifndef STORAGE_RETRY_DELAY
+#define STORAGE_RETRY_DELAY                     (1000u)                 // Wait before retry of postponed commit
+#endif
+#ifndef STORAGE_ASYNC_POLL_INTERVAL
+#define STORAGE_ASYNC_POLL_INTERVAL             (10u)                   // Check for finished async commit
+#endif
+#ifndef STORAGE_ASYNC_WAIT_TIMEOUT
+#define STORAGE_ASYNC_WAIT_TIMEOUT              (5000u)                 // Interval of debug messages while destructor waits for running write
+#endif
+
+/**
+ * FULL - every commit rewrites the whole file
+ * JOURNAL - commit appends only changed byte ranges to the journal file, load replays them on top of the data file.
+ *      Journal is folded into the data file once it grows over STORAGE_JOURNAL_MAX_SIZE.
+ *      Requires additional sizeof(T) bytes of RAM to keep a copy of committed data.
+ *      Don't switch mode back to FULL without committing, journal is ignored in FULL mode.
+ * DOUBLE_BUFFER - file contains two slots with sequence number and checksum, commit always writes the inactive slot,
+ *      so interrupted write never damages the live data. Load picks the newest valid slot.
+ *      File written in FULL mode is loaded and converted on the first commit.
+ *
+ * JOURNAL and DOUBLE_BUFFER fall back to FULL if backend doesn't support appends or partial writes.
+ */
+MAKE_ENUM_AUTO(StorageMode, uint8_t,
+    FULL,
+    JOURNAL,
+    DOUBLE_BUFFER,
+)
+
+struct StorageStats {
+    uint32_t commits = 0;           // Successful writes to FLASH
+    uint32_t skipped = 0;           // Commits skipped because data wasn't changed
+    uint32_t failed = 0;
+    uint32_t bytes_written = 0;
+};
+
+// Outcome of the backend write, Storage state is updated from it on the loop
+struct StorageCommitResult {
+    bool success = false;
+    bool journal = false;           // Changes appended to the journal instead of the full write
+    size_t bytes_written = 0;
+    size_t journal_size = 0;
+    uint32_t slot_seq = 0;
+    uint8_t slot = 0;
+};
+
+#ifdef ARDUINO_ARCH_ESP32
+
+enum class StorageAsyncStage : uint8_t {
+    PENDING,
+    RUNNING,
+    FINISHED,
+    CANCELLED,
+};
+
+// Shared with the background task, so it stays valid after Storage drops the commit
+template<typename T>
+struct StorageAsyncCommit {
+    T data;
+    uint32_t crc = 0;
+    StorageCommitResult result{};
+
+    // Task doesn't touch Storage unless it moves the commit from PENDING to RUNNING
+    std::atomic<StorageAsyncStage> stage{StorageAsyncStage::PENDING};
+};
+
+#endif
+
+class StorageManager;
+
+/**
+ * Type-erased part of Storage, used by StorageManager to handle instances of different types
+ */
+class StorageBase {
+    friend class StorageManager;
+
+    StorageManager *_manager = nullptr;
+
+protected:
+    StorageStats _stats{};
+    StorageFlushPolicy *_policy = nullptr;
+
+public:
+    virtual ~StorageBase() = default;
+
+    virtual void begin(StorageBackend *backend) = 0;
+
+    [[nodiscard]] virtual const char *key() const = 0;
+    [[nodiscard]] virtual bool is_pending_commit() const = 0;
+    [[nodiscard]] virtual bool is_commit_in_progress() const = 0;
+
+    [[nodiscard]] inline const StorageStats &stats() const { return _stats; }
+    [[nodiscard]] inline bool is_managed() const { return _manager != nullptr; }
+
+    /**
+     * Policy isn't owned by Storage and can be shared, then every commit of every instance is charged separately.
+     * Managed instances use policy of StorageManager, which charges a whole commit pass once.
+     */
+    inline void set_flush_policy(StorageFlushPolicy *policy) { _policy = policy; }
+    [[nodiscard]] inline StorageFlushPolicy *flush_policy() const { return _policy; }
+
+    virtual void save() = 0;
+    virtual void force_save() = 0;
+
+protected:
+    // Schedule shared commit of StorageManager, defined in storage_manager.cpp
+    void _request_commit();
+    void _request_retry(unsigned long delay);
+
+    // Commit triggered by timer, may be performed asynchronously
+    virtual void _commit_scheduled() = 0;
+
+    // Data differs from the committed one and no commit is in progress
+    [[nodiscard]] virtual bool _is_commit_needed() const = 0;
+};
 
 template<typename T, typename = std::enable_if_t<std::is_standard_layout_v<T>>>
-class Storage {
-    FS *_fs = nullptr;
+class Storage : public StorageBase {
+    // Journal records and size() use 16-bit offsets and lengths
+    static_assert(sizeof(T) <= UINT16_MAX - 16, "Storage value is too large");
+
+    StorageBackend *_backend = nullptr;
+    std::unique_ptr<StorageFsBackend> _fs_backend;
+
     Timer &_timer;
 
     const char *_key;
@@ -24,81 +168,400 @@ class Storage {
 
     uint8_t _version;
     uint32_t _header;
-    long _save_timer_id = -1;
+    StorageMode _mode;
+    TimerId _save_timer_id = TIMER_INVALID_ID;
+    bool _dirty = false;           // Waiting for StorageManager commit
+
+    // Checksum of the data image which is currently stored in FLASH
+    uint32_t _committed_crc = 0;
+    bool _committed_valid = false;
+
+    // Checksum of the data file, journal is valid only on top of it
+    uint32_t _snapshot_crc = 0;
+
+    uint8_t *_shadow = nullptr;
+    size_t _journal_size = 0;
+    TimerId _compact_timer_id = TIMER_INVALID_ID;
+
+    uint32_t _slot_seq = 0;
+    uint8_t _active_slot = 0;
+    bool _slots_ready = false;     // File already has double buffer layout
+
+#ifdef ARDUINO_ARCH_ESP32
+    bool _async_commit = false;
+
+    std::shared_ptr<StorageAsyncCommit<T>> _async_state = nullptr;
+    std::shared_ptr<Promise<void>> _async_promise = nullptr;
+    TimerId _async_timer_id = TIMER_INVALID_ID;
+
+    bool _force_pending = false;    // force_save() requested while write is running
+#endif
 
 public:
-    Storage(Timer &timer, const char *key, uint8_t version = 1, uint32_t header = 0xd0c1f2c3);
+    Storage(Timer &timer, const char *key, uint8_t version = 1, uint32_t header = 0xd0c1f2c3,
+            StorageMode mode = StorageMode::FULL);
+    ~Storage() override;
 
     Storage(const Storage &) = delete;
     Storage &operator=(const Storage &) = delete;
 
+    // Files under STORAGE_PATH of the filesystem
     void begin(FS *fs);
 
+    // Backend isn't owned by Storage and can be shared
+    void begin(StorageBackend *backend) override;
+
     [[nodiscard]] inline T &get() { return _data; }
     [[nodiscard]] inline const T &get() const { return _data; }
 
-    [[nodiscard]] inline uint16_t size() const { return sizeof(_header) + sizeof(_version) + sizeof(T); }
+    [[nodiscard]] inline uint16_t size() const { return sizeof(_header) + sizeof(_version) + sizeof(_committed_crc) + sizeof(T); }
 
+    [[nodiscard]] inline const char *key() const override { return _key; }
+    [[nodiscard]] inline StorageBackend *backend() const { return _backend; }
     [[nodiscard]] inline Timer &timer() const { return _timer; }
-    [[nodiscard]] inline bool is_pending_commit() const { return _save_timer_id != -1; }
+    [[nodiscard]] inline bool is_pending_commit() const override { return _dirty || _save_timer_id != TIMER_INVALID_ID; }
+
+    [[nodiscard]] inline StorageMode mode() const { return _mode; }
+    [[nodiscard]] inline size_t journal_size() const { return _journal_size; }
+
+    [[nodiscard]] bool is_commit_in_progress() const override;
 
     void reset();
-    void save();
-    void force_save();
+    void save() override;
+    void force_save() override;
+
+#ifdef ARDUINO_ARCH_ESP32
+    /**
+     * Scheduled commits copy data to the staging buffer and write it on the Dispatcher task,
+     * so flash erase doesn't block the loop.
+     * force_save() stays synchronous: it drops a commit which isn't started yet,
+     * or writes right after the running one is applied.
+     */
+    inline void set_async_commit(bool value) { _async_commit = value; }
+    [[nodiscard]] inline bool async_commit() const { return _async_commit; }
+
+    // Result is resolved on the Dispatcher task, Storage state is updated later on the loop.
+    // Fails if previous commit is still in progress
+    Future<void> commit_async();
+#endif
+
+protected:
+    void _commit_scheduled() override;
+    [[nodiscard]] bool _is_commit_needed() const override;
 
 private:
-    [[nodiscard]] inline String _get_path() const { return String(STORAGE_PATH) + _key; };
-    [[nodiscard]] bool _check_header(File &file, uint32_t &out_header, uint8_t out_version) const;
-    [[nodiscard]] bool _check_header(File &file) const;
+    [[nodiscard]] inline String _get_journal_key() const { return String(_key) + STORAGE_JOURNAL_SUFFIX; };
+    [[nodiscard]] inline uint16_t _legacy_size() const { return sizeof(_header) + sizeof(_version) + sizeof(T); }
+    [[nodiscard]] inline uint16_t _slot_size() const { return size() + sizeof(_slot_seq); }
+    [[nodiscard]] bool _check_header(const uint8_t *ptr, uint32_t &out_header, uint8_t &out_version) const;
+
+    bool _load_snapshot();
+    void _load_journal();
+    bool _load_slots();
+
+    [[nodiscard]] inline bool _is_changed() const { return !_committed_valid || crc32_calc(&_data, sizeof(T)) != _committed_crc; }
+
+    void _schedule_save(unsigned long delay);
+    void _retry_commit(unsigned long delay);
 
     void _commit_impl();
-    bool _check_changed(File &file);
+    bool _commit_data(const T &data, uint32_t crc);
+    bool _apply_commit(const T &data, uint32_t crc, const StorageCommitResult &result);
+
+    // Backend I/O only, so it can be called from the background task
+    void _write_data(const T &data, uint32_t crc, StorageCommitResult &result) const;
+    bool _write_snapshot(const T &data, uint32_t crc, StorageCommitResult &result) const;
+    bool _append_journal(const T &data, StorageCommitResult &result) const;
+    bool _write_slot(const T &data, uint32_t crc, StorageCommitResult &result) const;
+    void _fill_slot_chunks(StorageChunk *chunks, const T &data, const uint32_t &seq, const uint32_t &crc) const;
+
+    void _schedule_compaction();
+    void _compact();
+
+#ifdef ARDUINO_ARCH_ESP32
+    void _finish_async_commit();
+    bool _cancel_async_commit();
+#endif
+
+    template<typename Fn>
+    void _for_each_change(const T &data, Fn fn) const;
 };
 
 
 template<typename T, typename S1>
-Storage<T, S1>::Storage(Timer &timer, const char *key, uint8_t version, uint32_t header) :
-        _timer(timer), _key(key), _version(version), _header(header) {}
+Storage<T, S1>::Storage(Timer &timer, const char *key, uint8_t version, uint32_t header, StorageMode mode) :
+        _timer(timer), _key(key), _version(version), _header(header), _mode(mode) {}
+
+template<typename T, typename S1>
+Storage<T, S1>::~Storage() {
+    if (_save_timer_id != TIMER_INVALID_ID) _timer.clear_timeout(_save_timer_id);
+    if (_compact_timer_id != TIMER_INVALID_ID) _timer.clear_timeout(_compact_timer_id);
+
+#ifdef ARDUINO_ARCH_ESP32
+    if (_async_timer_id != TIMER_INVALID_ID) _timer.clear_interval(_async_timer_id);
+
+    // Queued commit is dropped without waiting, only the running write refers to this instance
+    if (_async_promise && !_cancel_async_commit()) {
+        while (_async_state->stage == StorageAsyncStage::RUNNING && !_async_promise->wait(STORAGE_ASYNC_WAIT_TIMEOUT)) {
+            D_PRINTF("Storage(%s): Still waiting for async commit\r\n", _key);
+        }
+    }
+#endif
+
+    delete[] _shadow;
+}
 
 template<typename T, typename S1>
 void Storage<T, S1>::begin(FS *fs) {
-    _fs = fs;
+    _fs_backend = std::make_unique<StorageFsBackend>(fs);
+    begin(_fs_backend.get());
+}
 
-    const String path = _get_path();
+template<typename T, typename S1>
+void Storage<T, S1>::begin(StorageBackend *backend) {
+    _backend = backend;
 
-    bool success = false;
+    if (_mode == StorageMode::JOURNAL && !_backend->supports_append()) {
+        D_PRINTF("Storage(%s): Backend doesn't support journal, fallback to FULL mode\r\n", _key);
+        _mode = StorageMode::FULL;
+    } else if (_mode == StorageMode::DOUBLE_BUFFER && !_backend->supports_partial_write()) {
+        D_PRINTF("Storage(%s): Backend doesn't support double buffer, fallback to FULL mode\r\n", _key);
+        _mode = StorageMode::FULL;
+    }
+
+    if (_mode == StorageMode::JOURNAL && !_shadow) _shadow = new uint8_t[sizeof(T)];
+
+    bool success = _mode == StorageMode::DOUBLE_BUFFER ? _load_slots() : _load_snapshot();
+    if (!success) {
+        D_PRINTF("Storage(%s): Reset value...\r\n", _key);
+        _data = T();
+    }
+
+    if (_mode != StorageMode::JOURNAL) return;
+
+    memcpy(_shadow, &_data, sizeof(T));
+    if (success) _load_journal();
+}
 
-    if (_fs->exists(path)) {
-        auto file = _fs->open(path, "r");
+template<typename T, typename S1>
+bool Storage<T, S1>::_load_snapshot() {
+    if (!_backend->exists(_key)) {
+        D_PRINTF("Storage(%s): Data doesn't exists\r\n", _key);
+        return false;
+    }
+
+    const size_t file_size = _backend->size(_key);
+
+    // Files written before checksum was introduced are loaded without validation
+    const bool legacy = file_size == _legacy_size();
+    if (file_size != size() && !legacy) {
+        D_PRINTF("Storage(%s): Size doesn't match, expected %u, got %u\r\n", _key, size(), file_size);
+        return false;
+    }
+
+    uint8_t prefix[sizeof(_header) + sizeof(_version) + sizeof(_committed_crc)];
+    const size_t prefix_size = legacy ? sizeof(_header) + sizeof(_version) : sizeof(prefix);
+
+    if (_backend->read(_key, 0, prefix, prefix_size) != prefix_size
+        || _backend->read(_key, prefix_size, &_data, sizeof(T)) != sizeof(T)) {
+        D_PRINTF("Storage(%s): Unable to read data\r\n", _key);
+        return false;
+    }
+
+    decltype(_header) saved_header;
+    decltype(_version) saved_version;
+    decltype(_committed_crc) saved_crc = 0;
+
+    if (!_check_header(prefix, saved_header, saved_version)) {
+        D_PRINTF("Storage(%s): Unsupported value, expected version: %u, header: %X\r\n", _key, _version, _header);
+        return false;
+    }
+
+    if (!legacy) memcpy(&saved_crc, prefix + sizeof(_header) + sizeof(_version), sizeof(saved_crc));
+
+    const auto crc = crc32_calc(&_data, sizeof(_data));
+    if (!legacy && crc != saved_crc) {
+        D_PRINTF("Storage(%s): Checksum mismatch, expected %08X, got %08X\r\n", _key, saved_crc, crc);
+        return false;
+    }
+
+    _committed_crc = crc;
+    _committed_valid = !legacy;
+    _snapshot_crc = crc;
 
-        if (file.size() == size()) {
-            decltype(_header) saved_header;
-            decltype(_version) saved_version;
+    D_PRINTF("Storage(%s): Loaded stored value version: %u, size %u\r\n", _key, saved_version, file_size);
+    return true;
+}
+
+template<typename T, typename S1>
+void Storage<T, S1>::_load_journal() {
+    const String journal_key = _get_journal_key();
+    if (!_committed_valid || !_backend->exists(journal_key.c_str())) return;
+
+    // Journal is bounded by compaction, so it's read at once to avoid many small reads.
+    // Appends stop at STORAGE_JOURNAL_MAX_SIZE and a record is smaller than data, anything larger is garbage
+    const size_t journal_size = _backend->size(journal_key.c_str());
+    if (journal_size > STORAGE_JOURNAL_MAX_SIZE + sizeof(T)) {
+        D_PRINTF("Storage(%s): Journal is too large (%u), skip\r\n", _key, journal_size);
+        return;
+    }
 
-            file.read((uint8_t *) &saved_header, sizeof(_header));
-            file.read((uint8_t *) &saved_version, sizeof(_version));
+    auto *buffer = new uint8_t[journal_size];
 
-            if (saved_header == _header && saved_version == _version) {
-                file.read((uint8_t *) &_data, sizeof(_data));
-                success = true;
+    const size_t read = _backend->read(journal_key.c_str(), 0, buffer, journal_size);
 
-                D_PRINTF("Storage(%s): Loaded stored value version: %u, size %u\r\n", _key, saved_version, size());
-            } else {
-                D_PRINTF("Storage(%s): Unsupported value, expected version: %u, header: %X\r\n", _key, _version, _header);
-            }
-        } else {
-            D_PRINTF("Storage(%s): Size doesn't match, expected %u, got %u\r\n", _key, size(), file.size());
+    size_t position = 0;
+    auto take = [&](void *dst, size_t size, uint32_t &crc) {
+        if (position + size > read) return false;
+
+        memcpy(dst, buffer + position, size);
+        crc = crc32_calc(buffer + position, size, crc);
+        position += size;
+
+        return true;
+    };
+
+    decltype(_header) saved_header;
+    decltype(_version) saved_version;
+    decltype(_snapshot_crc) base_crc = 0;
+
+    constexpr size_t header_size = sizeof(_header) + sizeof(_version) + sizeof(_snapshot_crc);
+    if (read >= header_size) memcpy(&base_crc, buffer + sizeof(_header) + sizeof(_version), sizeof(base_crc));
+
+    if (read < header_size || !_check_header(buffer, saved_header, saved_version) || base_crc != _snapshot_crc) {
+        // Journal left from the previous data file, it will be overwritten by the next commit
+        D_PRINTF("Storage(%s): Journal doesn't match data file, skip\r\n", _key);
+
+        delete[] buffer;
+        return;
+    }
+
+    size_t records = 0;
+    bool corrupted = false;
+
+    position = header_size;
+    _journal_size = position;
+
+    while (position < read) {
+        uint32_t crc = 0;
+        uint16_t count = 0;
+
+        bool valid = take(&count, sizeof(count), crc);
+        for (uint16_t i = 0; valid && i < count; ++i) {
+            uint16_t offset = 0, length = 0;
+            valid = take(&offset, sizeof(offset), crc)
+                    && take(&length, sizeof(length), crc)
+                    && (size_t) offset + length <= sizeof(T)
+                    && take((uint8_t *) &_data + offset, length, crc);
         }
 
-        file.close();
-    } else {
+        uint32_t saved_crc = 0, unused = 0;
+        if (!valid || !take(&saved_crc, sizeof(saved_crc), unused) || saved_crc != crc) {
+            // Interrupted append: revert partially applied record and drop the tail
+            memcpy(&_data, _shadow, sizeof(T));
+
+            corrupted = true;
+            break;
+        }
+
+        memcpy(_shadow, &_data, sizeof(T));
+
+        _journal_size = position;
+        records++;
+    }
+
+    delete[] buffer;
+
+    _committed_crc = crc32_calc(&_data, sizeof(T));
+
+    D_PRINTF("Storage(%s): Replayed %u journal records, size %u\r\n", _key, records, _journal_size);
+
+    if (corrupted || read != journal_size) {
+        // Journal can't be appended after the broken record, so the next commit will rewrite the data file
+        D_PRINTF("Storage(%s): Journal is corrupted, skip the rest\r\n", _key);
+        _committed_valid = false;
+    } else if (_journal_size >= STORAGE_JOURNAL_MAX_SIZE) {
+        _schedule_compaction();
+    }
+}
+
+template<typename T, typename S1>
+bool Storage<T, S1>::_load_slots() {
+    if (!_backend->exists(_key)) {
         D_PRINTF("Storage(%s): Data doesn't exists\r\n", _key);
+        return false;
     }
 
-    if (!success) {
-        D_PRINTF("Storage(%s): Reset value...\r\n", _key);
-        _data = T();
+    const size_t slot_size = _slot_size();
+
+    if (_backend->size(_key) != 2 * slot_size) {
+        // Data file is written in FULL mode, it will be converted on the next commit
+        D_PRINTF("Storage(%s): No slots found, fallback to data file\r\n", _key);
+
+        const bool success = _load_snapshot();
+        _committed_valid = false;
+
+        return success;
     }
+
+    // Both slots are read at once, so newest one can be picked without seeking
+    auto *buffer = new uint8_t[2 * slot_size];
+    const size_t read = _backend->read(_key, 0, buffer, 2 * slot_size);
+
+    _slots_ready = true;
+
+    int8_t newest = -1;
+    uint32_t newest_seq = 0, newest_crc = 0;
+
+    for (uint8_t slot = 0; read == 2 * slot_size && slot < 2; ++slot) {
+        const uint8_t *ptr = buffer + slot * slot_size;
+
+        decltype(_header) saved_header;
+        decltype(_version) saved_version;
+        decltype(_slot_seq) saved_seq;
+        decltype(_committed_crc) saved_crc;
+
+        const bool supported = _check_header(ptr, saved_header, saved_version);
+        ptr += sizeof(saved_header) + sizeof(saved_version);
+
+        memcpy(&saved_seq, ptr, sizeof(saved_seq));
+        ptr += sizeof(saved_seq);
+        memcpy(&saved_crc, ptr, sizeof(saved_crc));
+        ptr += sizeof(saved_crc);
+
+        if (!supported) {
+            D_PRINTF("Storage(%s): Slot %u has unsupported value, expected version: %u, header: %X\r\n", _key, slot, _version, _header);
+            continue;
+        }
+
+        const auto crc = crc32_calc(ptr, sizeof(T));
+        if (crc32_calc(&saved_seq, sizeof(saved_seq), crc) != saved_crc) {
+            D_PRINTF("Storage(%s): Slot %u checksum mismatch\r\n", _key, slot);
+            continue;
+        }
+
+        if (newest < 0 || (int32_t) (saved_seq - newest_seq) > 0) {
+            newest = (int8_t) slot;
+            newest_seq = saved_seq;
+            newest_crc = crc;
+        }
+    }
+
+    if (newest >= 0) {
+        memcpy(&_data, buffer + newest * slot_size + slot_size - sizeof(T), sizeof(T));
+
+        _active_slot = newest;
+        _slot_seq = newest_seq;
+        _committed_crc = newest_crc;
+        _committed_valid = true;
+
+        D_PRINTF("Storage(%s): Loaded stored value version: %u from slot %u, seq %u\r\n", _key, _version, newest, newest_seq);
+    } else {
+        D_PRINTF("Storage(%s): No valid slots\r\n", _key);
+    }
+
+    delete[] buffer;
+    return newest >= 0;
 }
 
 template<typename T, typename S1>
@@ -109,85 +572,520 @@ void Storage<T, S1>::reset() {
 
 template<typename T, typename S1>
 void Storage<T, S1>::_commit_impl() {
-    if (!_fs) return;
+    if (!_backend) return;
 
-    File file = _fs->open(_get_path(), "r");
-    if (file && !_check_changed(file)) {
-        file.close();
+    const auto crc = crc32_calc(&_data, sizeof(T));
+    if (_committed_valid && crc == _committed_crc) {
         D_PRINTF("Storage(%s): Skip commit, data not changed\r\n", _key);
+
+        _stats.skipped++;
+        return;
+    }
+
+    _commit_data(_data, crc);
+    if (_journal_size >= STORAGE_JOURNAL_MAX_SIZE) _schedule_compaction();
+}
+
+template<typename T, typename S1>
+bool Storage<T, S1>::_commit_data(const T &data, uint32_t crc) {
+    StorageCommitResult result;
+    _write_data(data, crc, result);
+
+    return _apply_commit(data, crc, result);
+}
+
+template<typename T, typename S1>
+void Storage<T, S1>::_write_data(const T &data, uint32_t crc, StorageCommitResult &result) const {
+    if (_mode == StorageMode::JOURNAL && _committed_valid && _append_journal(data, result)) return;
+
+    if (_mode == StorageMode::DOUBLE_BUFFER) _write_slot(data, crc, result);
+    else _write_snapshot(data, crc, result);
+}
+
+template<typename T, typename S1>
+bool Storage<T, S1>::_apply_commit(const T &data, uint32_t crc, const StorageCommitResult &result) {
+    _stats.bytes_written += result.bytes_written;
+
+    if (!result.success) {
+        // Inactive slot write doesn't touch the live data
+        if (_mode != StorageMode::DOUBLE_BUFFER) _committed_valid = false;
+
+        _stats.failed++;
+        return false;
+    }
+
+    _committed_crc = crc;
+    _committed_valid = true;
+    _stats.commits++;
+
+    if (result.journal) {
+        memcpy(_shadow, &data, sizeof(T));
+        _journal_size = result.journal_size;
+
+        D_PRINTF("Storage(%s): Changes appended to journal, size %u\r\n", _key, _journal_size);
+        return true;
+    }
+
+    if (_mode == StorageMode::DOUBLE_BUFFER) {
+        _active_slot = result.slot;
+        _slot_seq = result.slot_seq;
+        _slots_ready = true;
+    } else {
+        _snapshot_crc = crc;
+
+        if (_mode == StorageMode::JOURNAL) {
+            memcpy(_shadow, &data, sizeof(T));
+            _journal_size = 0;
+        }
+    }
+
+    D_PRINTF("Storage(%s): Changes committed\r\n", _key);
+    return true;
+}
+
+template<typename T, typename S1>
+void Storage<T, S1>::_commit_scheduled() {
+    _dirty = false;
+
+#ifdef ARDUINO_ARCH_ESP32
+    // Committed state isn't consistent until the background commit is applied
+    _finish_async_commit();
+    if (is_commit_in_progress()) {
+        _retry_commit(STORAGE_RETRY_DELAY);
         return;
     }
+#endif
 
-#ifdef ESP32
-    file = _fs->open(_get_path(), "w", true);
+    // Budget of managed instance is charged by StorageManager for the whole commit pass
+    if (_policy && !is_managed()) {
+        _policy->on_commit();
+
+        const unsigned long wait = _is_changed() ? _policy->acquire_write(millis()) : 0;
+        if (wait > 0) {
+            _retry_commit(wait);
+            return;
+        }
+    }
+
+#ifdef ARDUINO_ARCH_ESP32
+    if (_async_commit) {
+        commit_async();
+        return;
+    }
+#endif
+
+    _commit_impl();
+}
+
+template<typename T, typename S1>
+bool Storage<T, S1>::_is_commit_needed() const {
+    // Committed state belongs to the background task until the commit is applied
+    return !is_commit_in_progress() && _is_changed();
+}
+
+template<typename T, typename S1>
+bool Storage<T, S1>::is_commit_in_progress() const {
+#ifdef ARDUINO_ARCH_ESP32
+    // Stays in progress after the write until the result is applied on the loop
+    return _async_promise != nullptr;
 #else
-    file = _fs->open(_get_path(), "w");
+    return false;
 #endif
+}
 
-    file.write((uint8_t *) &_header, sizeof(_header));
-    file.write((uint8_t *) &_version, sizeof(_version));
-    file.write((uint8_t *) &_data, sizeof(T));
+#ifdef ARDUINO_ARCH_ESP32
 
-    D_PRINTF("Storage(%s): Changes committed\r\n", _key);
+template<typename T, typename S1>
+Future<void> Storage<T, S1>::commit_async() {
+    if (!_backend) return Future<void>::errored();
+
+    _finish_async_commit();
+    if (is_commit_in_progress()) {
+        D_PRINTF("Storage(%s): Commit is already in progress\r\n", _key);
+        return Future<void>::errored();
+    }
 
-    file.close();
+    const auto crc = crc32_calc(&_data, sizeof(T));
+    if (_committed_valid && crc == _committed_crc) {
+        D_PRINTF("Storage(%s): Skip commit, data not changed\r\n", _key);
+
+        _stats.skipped++;
+        return Future<void>::successful();
+    }
+
+    // Staging buffer is reused unless the task of the dropped commit still holds it
+    if (!_async_state || _async_state.use_count() > 1) _async_state = std::make_shared<StorageAsyncCommit<T>>();
+
+    auto state = _async_state;
+    memcpy((void *) &state->data, &_data, sizeof(T));
+
+    state->crc = crc;
+    state->result = {};
+    state->stage = StorageAsyncStage::PENDING;
+
+    auto promise = Promise<void>::create();
+    _async_promise = promise;
+
+    D_PRINTF("Storage(%s): Dispatch async commit\r\n", _key);
+    const bool dispatched = Dispatcher::dispatch([this, state, promise] {
+        auto expected = StorageAsyncStage::PENDING;
+        if (!state->stage.compare_exchange_strong(expected, StorageAsyncStage::RUNNING)) {
+            // Dropped by force_save() or destructor, instance may be already destroyed
+            promise->set_error();
+            return;
+        }
+
+        // Storage state is read only, result is applied on the loop by _finish_async_commit()
+        _write_data(state->data, state->crc, state->result);
+        state->stage = StorageAsyncStage::FINISHED;
+
+        if (state->result.success) promise->set_success();
+        else promise->set_error();
+    });
+
+    if (!dispatched) {
+        D_PRINTF("Storage(%s): Unable to dispatch async commit\r\n", _key);
+
+        _async_promise = nullptr;
+        _stats.failed++;
+
+        return Future<void>::errored();
+    }
+
+    _async_timer_id = _timer.add_interval([](void *param) {
+        ((Storage *) param)->_finish_async_commit();
+    }, STORAGE_ASYNC_POLL_INTERVAL, this);
+
+    return promise;
 }
 
 template<typename T, typename S1>
-bool Storage<T, S1>::_check_header(File &file, uint32_t &out_header, uint8_t out_version) const {
-    file.read((uint8_t *) &out_header, sizeof(_header));
-    file.read((uint8_t *) &out_version, sizeof(_version));
+void Storage<T, S1>::_finish_async_commit() {
+    if (!_async_promise || !_async_promise->finished()) return;
 
-    return out_header == _header && out_version == _version;
+    if (_async_timer_id != TIMER_INVALID_ID) {
+        _timer.clear_interval(_async_timer_id);
+        _async_timer_id = TIMER_INVALID_ID;
+    }
+
+    _async_promise = nullptr;
+
+    _apply_commit(_async_state->data, _async_state->crc, _async_state->result);
+    if (_journal_size >= STORAGE_JOURNAL_MAX_SIZE) _schedule_compaction();
+
+    if (_force_pending) {
+        _force_pending = false;
+        _commit_impl();
+    }
+}
+
+template<typename T, typename S1>
+bool Storage<T, S1>::_cancel_async_commit() {
+    auto expected = StorageAsyncStage::PENDING;
+    if (!_async_state->stage.compare_exchange_strong(expected, StorageAsyncStage::CANCELLED)) return false;
+
+    if (_async_timer_id != TIMER_INVALID_ID) {
+        _timer.clear_interval(_async_timer_id);
+        _async_timer_id = TIMER_INVALID_ID;
+    }
+
+    // Task resolves the promise and releases the staging buffer on its own
+    _async_promise = nullptr;
+    return true;
+}
+
+#endif
+
+template<typename T, typename S1>
+bool Storage<T, S1>::_write_snapshot(const T &data, uint32_t crc, StorageCommitResult &result) const {
+    const StorageChunk chunks[] = {
+        {&_header, sizeof(_header)},
+        {&_version, sizeof(_version)},
+        {&crc, sizeof(crc)},
+        {&data, sizeof(T)},
+    };
+
+    const size_t written = _backend->write(_key, chunks, std::size(chunks));
+    result.bytes_written += written;
+
+    if (written != size()) {
+        D_PRINTF("Storage(%s): Commit failed, written %u of %u\r\n", _key, written, size());
+
+        result.success = false;
+        return false;
+    }
+
+    if (_mode == StorageMode::JOURNAL) {
+        // Journal is bound to the previous data file by its checksum, so it stays consistent even if removal fails
+        const String journal_key = _get_journal_key();
+        if (_backend->exists(journal_key.c_str())) _backend->remove(journal_key.c_str());
+    }
+
+    result.success = true;
+    result.journal = false;
+
+    return true;
+}
+
+template<typename T, typename S1>
+bool Storage<T, S1>::_append_journal(const T &data, StorageCommitResult &result) const {
+    // Record: [count] { [offset] [length] [bytes] } * count [crc]
+    size_t count = 0;
+    size_t record_size = sizeof(uint16_t) + sizeof(uint32_t);
+
+    _for_each_change(data, [&](uint16_t, uint16_t length) {
+        count++;
+        record_size += 2 * sizeof(uint16_t) + length;
+    });
+
+    // Large changes are cheaper to write as a whole.
+    // Full write also folds the journal if compaction is late, so the journal size stays bounded
+    if (record_size >= sizeof(T) || count > UINT16_MAX || _journal_size >= STORAGE_JOURNAL_MAX_SIZE) return false;
+
+    const String journal_key = _get_journal_key();
+    size_t journal_size = _journal_size;
+
+    if (journal_size == 0) {
+        const StorageChunk chunks[] = {
+            {&_header, sizeof(_header)},
+            {&_version, sizeof(_version)},
+            {&_snapshot_crc, sizeof(_snapshot_crc)},
+        };
+
+        const size_t written = _backend->write(journal_key.c_str(), chunks, std::size(chunks));
+
+        result.bytes_written += written;
+        if (written != sizeof(_header) + sizeof(_version) + sizeof(_snapshot_crc)) return false;
+
+        journal_size = written;
+    }
+
+    // Record is smaller than data, so it's assembled in a single buffer and appended at once
+    auto *record = new uint8_t[record_size];
+    size_t position = 0;
+
+    auto put = [&](const void *ptr, size_t size) {
+        memcpy(record + position, ptr, size);
+        position += size;
+    };
+
+    const auto record_count = (uint16_t) count;
+    put(&record_count, sizeof(record_count));
+
+    _for_each_change(data, [&](uint16_t offset, uint16_t length) {
+        put(&offset, sizeof(offset));
+        put(&length, sizeof(length));
+        put((const uint8_t *) &data + offset, length);
+    });
+
+    const uint32_t crc = crc32_calc(record, position);
+    put(&crc, sizeof(crc));
+
+    const StorageChunk chunk{record, record_size};
+    const size_t written = _backend->append(journal_key.c_str(), &chunk, 1);
+
+    delete[] record;
+
+    result.bytes_written += written;
+    if (written != record_size) {
+        // Broken record will be dropped on load, fallback to the full write
+        D_PRINTF("Storage(%s): Journal append failed, written %u of %u\r\n", _key, written, record_size);
+        return false;
+    }
+
+    result.success = true;
+    result.journal = true;
+    result.journal_size = journal_size + record_size;
+
+    return true;
+}
+
+template<typename T, typename S1>
+bool Storage<T, S1>::_write_slot(const T &data, uint32_t crc, StorageCommitResult &result) const {
+    const uint32_t seq = _slot_seq + 1;
+    const uint32_t slot_crc = crc32_calc(&seq, sizeof(seq), crc);
+    const size_t slot_size = _slot_size();
+
+    constexpr size_t slot_chunks = 5;
+    StorageChunk chunks[2 * slot_chunks];
+
+    _fill_slot_chunks(chunks, data, seq, slot_crc);
+
+    uint8_t slot;
+    size_t written;
+    size_t expected_size;
+
+    if (_slots_ready) {
+        // Write only the inactive slot, live slot stays untouched until next commit
+        slot = 1 - _active_slot;
+        expected_size = slot_size;
+
+        written = _backend->write_at(_key, slot * slot_size, chunks, slot_chunks);
+    } else {
+        // Both slots are filled with the same value, atomic write keeps existing data valid until it's replaced
+        slot = 0;
+        expected_size = 2 * slot_size;
+
+        _fill_slot_chunks(chunks + slot_chunks, data, seq, slot_crc);
+        written = _backend->write(_key, chunks, 2 * slot_chunks, true);
+    }
+
+    result.bytes_written += written;
+    if (written != expected_size) {
+        D_PRINTF("Storage(%s): Commit to slot %u failed, written %u of %u\r\n", _key, slot, written, expected_size);
+
+        result.success = false;
+        return false;
+    }
+
+    result.success = true;
+    result.slot = slot;
+    result.slot_seq = seq;
+
+    return true;
+}
+
+template<typename T, typename S1>
+void Storage<T, S1>::_fill_slot_chunks(StorageChunk *chunks, const T &data, const uint32_t &seq, const uint32_t &crc) const {
+    chunks[0] = {&_header, sizeof(_header)};
+    chunks[1] = {&_version, sizeof(_version)};
+    chunks[2] = {&seq, sizeof(seq)};
+    chunks[3] = {&crc, sizeof(crc)};
+    chunks[4] = {&data, sizeof(T)};
+}
+
+template<typename T, typename S1>
+template<typename Fn>
+void Storage<T, S1>::_for_each_change(const T &value, Fn fn) const {
+    // Unchanged gap shorter than range header is cheaper to rewrite
+    constexpr size_t merge_gap = 2 * sizeof(uint16_t);
+
+    const auto *data = (const uint8_t *) &value;
+
+    size_t i = 0;
+    while (i < sizeof(T)) {
+        if (data[i] == _shadow[i]) {
+            ++i;
+            continue;
+        }
+
+        const size_t start = i;
+        size_t end = ++i;
+        while (i < sizeof(T) && i - end < merge_gap) {
+            if (data[i] != _shadow[i]) end = i + 1;
+            ++i;
+        }
+
+        fn((uint16_t) start, (uint16_t) (end - start));
+        i = end;
+    }
+}
+
+template<typename T, typename S1>
+void Storage<T, S1>::_schedule_compaction() {
+    if (_compact_timer_id != TIMER_INVALID_ID) return;
+
+    D_PRINTF("Storage(%s): Schedule journal compaction, size %u\r\n", _key, _journal_size);
+    _compact_timer_id = _timer.add_timeout([](void *param) {
+        auto *self = (Storage *) param;
+        self->_compact_timer_id = TIMER_INVALID_ID;
+        self->_compact();
+    }, STORAGE_JOURNAL_COMPACT_DELAY, this);
+
+    _timer.set_slack(_compact_timer_id, STORAGE_SAVE_SLACK);
 }
 
 template<typename T, typename S1>
-bool Storage<T, S1>::_check_header(File &file) const {
-    decltype(_header) saved_header{};
-    decltype(_version) saved_version{};
+void Storage<T, S1>::_compact() {
+    // Journal could be already folded by the full write
+    if (!_backend || _journal_size == 0) return;
+
+    if (is_commit_in_progress()) {
+        _schedule_compaction();
+        return;
+    }
+
+    // Data file is written with the latest value, so pending commit becomes no-op
+    const auto crc = crc32_calc(&_data, sizeof(T));
 
-    return _check_header(file, saved_header, saved_version);
+    StorageCommitResult result;
+    _write_snapshot(_data, crc, result);
+
+    if (_apply_commit(_data, crc, result)) {
+        D_PRINTF("Storage(%s): Journal compacted\r\n", _key);
+    }
+}
+
+template<typename T, typename S1>
+bool Storage<T, S1>::_check_header(const uint8_t *ptr, uint32_t &out_header, uint8_t &out_version) const {
+    memcpy(&out_header, ptr, sizeof(_header));
+    memcpy(&out_version, ptr + sizeof(_header), sizeof(_version));
+
+    return out_header == _header && out_version == _version;
 }
 
 template<typename T, typename S1>
 void Storage<T, S1>::save() {
-    if (!_fs) return;
+    if (!_backend) return;
+
+    if (is_managed()) {
+        _dirty = true;
+        _request_commit();
+        return;
+    }
 
-    if (_save_timer_id != -1) {
+    _schedule_save(_policy ? _policy->on_change(millis()) : STORAGE_SAVE_INTERVAL);
+}
+
+template<typename T, typename S1>
+void Storage<T, S1>::_schedule_save(unsigned long delay) {
+    if (_save_timer_id != TIMER_INVALID_ID) {
         D_PRINTF("Storage(%s): Clear existing save timer\r\n", _key);
         _timer.clear_timeout(_save_timer_id);
     }
 
-    D_PRINTF("Storage(%s): Schedule storage commit...\r\n", _key);
-    _save_timer_id = (long) _timer.add_timeout([](void *param) {
+    D_PRINTF("Storage(%s): Schedule storage commit in %lu ms...\r\n", _key, delay);
+    _save_timer_id = _timer.add_timeout([](void *param) {
         auto *self = (Storage *) param;
-        self->_save_timer_id = -1;
-        self->_commit_impl();
-    }, STORAGE_SAVE_INTERVAL, this);
+        self->_save_timer_id = TIMER_INVALID_ID;
+        self->_commit_scheduled();
+    }, delay, this);
+
+    _timer.set_slack(_save_timer_id, STORAGE_SAVE_SLACK);
+}
+
+template<typename T, typename S1>
+void Storage<T, S1>::_retry_commit(unsigned long delay) {
+    if (is_managed()) {
+        _dirty = true;
+        _request_retry(delay);
+    } else {
+        _schedule_save(delay);
+    }
 }
 
 template<typename T, typename S1>
 void Storage<T, S1>::force_save() {
-    if (_save_timer_id != -1) {
+    if (_save_timer_id != TIMER_INVALID_ID) {
         D_PRINTF("Storage(%s): Clear existing Storage save timer\r\n", _key);
 
         _timer.clear_timeout(_save_timer_id);
+        _save_timer_id = TIMER_INVALID_ID;
     }
 
-    _commit_impl();
-}
+    _dirty = false;
 
-template<typename T, typename S1>
-bool Storage<T, S1>::_check_changed(File &file) {
-    if (file.size() != size() || !_check_header(file)) return true;
+#ifdef ARDUINO_ARCH_ESP32
+    _finish_async_commit();
 
-    auto *ptr = (uint8_t *) &_data;
-    uint8_t entry;
+    // Queued commit is superseded by the current data, the running one can't be interrupted
+    if (_async_promise && !_cancel_async_commit()) {
+        D_PRINTF("Storage(%s): Async commit is in progress, force save after it\r\n", _key);
 
-    for (size_t i = 0; i < sizeof(T); ++i, ++ptr) {
-        file.read(&entry, 1);
-        if (*ptr != entry) return true;
+        _force_pending = true;
+        return;
     }
+#endif
 
-    return false;
+    _commit_impl();
 }
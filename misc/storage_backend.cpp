@@ -0,0 +1,411 @@
+#include "./storage_backend.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(ARDUINO_ARCH_ESP32) || defined(ARDUINO_ARCH_ESP8266)
+#include <Arduino.h>
+#endif
+
+#include "../debug.h"
+
+static constexpr size_t STORAGE_NPOS = (size_t) -1;
+static constexpr uint32_t STORAGE_ARENA_MAGIC = 0x5a7e0a3a;
+
+bool StorageMemoryBackend::exists(const char *key) {
+    return _find(key) != nullptr;
+}
+
+size_t StorageMemoryBackend::size(const char *key) {
+    auto *entry = _find(key);
+    return entry ? entry->data.size() : 0;
+}
+
+size_t StorageMemoryBackend::read(const char *key, size_t offset, void *data, size_t size) {
+    auto *entry = _find(key);
+    if (!entry || offset > entry->data.size()) return 0;
+
+    const size_t result = std::min(size, entry->data.size() - offset);
+    if (result > 0) memcpy(data, entry->data.data() + offset, result);
+
+    return result;
+}
+
+size_t StorageMemoryBackend::write(const char *key, const StorageChunk *chunks, size_t count, bool) {
+    auto *entry = _find(key);
+    if (!entry) {
+        _entries.push_back({key, {}});
+        entry = &_entries.back();
+    }
+
+    entry->data.clear();
+    return append(key, chunks, count);
+}
+
+size_t StorageMemoryBackend::write_at(const char *key, size_t offset, const StorageChunk *chunks, size_t count) {
+    auto *entry = _find(key);
+    if (!entry || offset > entry->data.size()) return 0;
+
+    const size_t total = storage_chunks_size(chunks, count);
+    if (entry->data.size() < offset + total) entry->data.resize(offset + total);
+
+    for (size_t i = 0; i < count; ++i) {
+        if (chunks[i].size > 0) memcpy(entry->data.data() + offset, chunks[i].data, chunks[i].size);
+        offset += chunks[i].size;
+    }
+
+    return total;
+}
+
+size_t StorageMemoryBackend::append(const char *key, const StorageChunk *chunks, size_t count) {
+    auto *entry = _find(key);
+    if (!entry) {
+        _entries.push_back({key, {}});
+        entry = &_entries.back();
+    }
+
+    return write_at(key, entry->data.size(), chunks, count);
+}
+
+bool StorageMemoryBackend::remove(const char *key) {
+    auto *entry = _find(key);
+    if (!entry) return false;
+
+    _entries.erase(_entries.begin() + (entry - _entries.data()));
+    return true;
+}
+
+StorageMemoryBackend::Entry *StorageMemoryBackend::_find(const char *key) {
+    for (auto &entry: _entries) {
+        if (strcmp(entry.key.c_str(), key) == 0) return &entry;
+    }
+
+    return nullptr;
+}
+
+StorageArenaBackend::StorageArenaBackend(uint8_t *buffer, size_t size) : _buffer(buffer), _buffer_size(size) {}
+
+void StorageArenaBackend::begin() {
+    uint32_t magic;
+    memcpy(&magic, _buffer, sizeof(magic));
+
+    if (magic == STORAGE_ARENA_MAGIC) return;
+
+    D_PRINT("StorageArenaBackend: No valid data, reset");
+
+    memset(_buffer, 0, _buffer_size);
+    memcpy(_buffer, &STORAGE_ARENA_MAGIC, sizeof(STORAGE_ARENA_MAGIC));
+
+    _sync();
+}
+
+bool StorageArenaBackend::exists(const char *key) {
+    return _find(key) != STORAGE_NPOS;
+}
+
+size_t StorageArenaBackend::size(const char *key) {
+    const size_t offset = _find(key);
+    return offset != STORAGE_NPOS ? _read_header(offset).size : 0;
+}
+
+size_t StorageArenaBackend::read(const char *key, size_t offset, void *data, size_t size) {
+    const size_t entry = _find(key);
+    if (entry == STORAGE_NPOS) return 0;
+
+    const auto header = _read_header(entry);
+    if (offset > header.size) return 0;
+
+    const size_t result = std::min(size, (size_t) header.size - offset);
+    if (result > 0) memcpy(data, _buffer + entry + sizeof(EntryHeader) + offset, result);
+
+    return result;
+}
+
+size_t StorageArenaBackend::write(const char *key, const StorageChunk *chunks, size_t count, bool) {
+    const size_t total = storage_chunks_size(chunks, count);
+    if (strlen(key) >= STORAGE_ARENA_KEY_SIZE || total > UINT16_MAX) return 0;
+
+    size_t entry = _find(key);
+    entry = entry != STORAGE_NPOS ? _reserve(entry, total) : _allocate(key, total);
+
+    if (entry == STORAGE_NPOS) {
+        D_PRINTF("StorageArenaBackend: Not enough space for %s, size %u\r\n", key, total);
+        return 0;
+    }
+
+    // Value is replaced, so previous size shouldn't be kept
+    auto header = _read_header(entry);
+    header.size = 0;
+    _write_header(entry, header);
+
+    const size_t written = _copy_chunks(entry, 0, chunks, count);
+    _sync();
+
+    return written;
+}
+
+size_t StorageArenaBackend::write_at(const char *key, size_t offset, const StorageChunk *chunks, size_t count) {
+    size_t entry = _find(key);
+    if (entry == STORAGE_NPOS || offset > _read_header(entry).size) return 0;
+
+    const size_t total = storage_chunks_size(chunks, count);
+    if (offset + total > UINT16_MAX) return 0;
+
+    entry = _reserve(entry, offset + total);
+    if (entry == STORAGE_NPOS) {
+        D_PRINTF("StorageArenaBackend: Not enough space for %s, size %u\r\n", key, offset + total);
+        return 0;
+    }
+
+    const size_t written = _copy_chunks(entry, offset, chunks, count);
+    _sync();
+
+    return written;
+}
+
+size_t StorageArenaBackend::append(const char *key, const StorageChunk *chunks, size_t count) {
+    if (!exists(key)) return write(key, chunks, count, false);
+
+    return write_at(key, size(key), chunks, count);
+}
+
+bool StorageArenaBackend::remove(const char *key) {
+    const size_t entry = _find(key);
+    if (entry == STORAGE_NPOS) return false;
+
+    // Entry stays in place as a free block
+    auto header = _read_header(entry);
+    header.key[0] = '\0';
+    header.size = 0;
+
+    _write_header(entry, header);
+    _sync();
+
+    return true;
+}
+
+size_t StorageArenaBackend::free_space() const {
+    const size_t tail = _tail() + sizeof(EntryHeader);
+    return tail < _buffer_size ? _buffer_size - tail : 0;
+}
+
+size_t StorageArenaBackend::_find(const char *key) const {
+    size_t offset = sizeof(STORAGE_ARENA_MAGIC);
+    while (offset + sizeof(EntryHeader) <= _buffer_size) {
+        const auto header = _read_header(offset);
+        if (header.capacity == 0) break;
+
+        if (strncmp(header.key, key, STORAGE_ARENA_KEY_SIZE) == 0) return offset;
+        offset += sizeof(EntryHeader) + header.capacity;
+    }
+
+    return STORAGE_NPOS;
+}
+
+size_t StorageArenaBackend::_tail() const {
+    size_t offset = sizeof(STORAGE_ARENA_MAGIC);
+    while (offset + sizeof(EntryHeader) <= _buffer_size) {
+        const auto header = _read_header(offset);
+        if (header.capacity == 0) break;
+
+        offset += sizeof(EntryHeader) + header.capacity;
+    }
+
+    return offset;
+}
+
+size_t StorageArenaBackend::_allocate(const char *key, size_t size) {
+    EntryHeader header{};
+    strncpy(header.key, key, STORAGE_ARENA_KEY_SIZE - 1);
+    header.size = 0;
+
+    // Reuse free block first
+    size_t offset = sizeof(STORAGE_ARENA_MAGIC);
+    while (offset + sizeof(EntryHeader) <= _buffer_size) {
+        const auto current = _read_header(offset);
+        if (current.capacity == 0) break;
+
+        if (current.key[0] == '\0' && current.capacity >= size) {
+            header.capacity = current.capacity;
+            _write_header(offset, header);
+
+            return offset;
+        }
+
+        offset += sizeof(EntryHeader) + current.capacity;
+    }
+
+    // Zero capacity marks the end of arena
+    size = std::max<size_t>(size, 1);
+    if (offset + sizeof(EntryHeader) + size > _buffer_size) return STORAGE_NPOS;
+
+    header.capacity = size;
+    _write_header(offset, header);
+
+    return offset;
+}
+
+size_t StorageArenaBackend::_reserve(size_t offset, size_t size) {
+    auto header = _read_header(offset);
+    if (header.capacity >= size) return offset;
+
+    // Last entry can grow in place
+    if (offset + sizeof(EntryHeader) + header.capacity == _tail()) {
+        if (offset + sizeof(EntryHeader) + size > _buffer_size) return STORAGE_NPOS;
+
+        header.capacity = size;
+        _write_header(offset, header);
+
+        return offset;
+    }
+
+    const size_t moved = _allocate(header.key, size);
+    if (moved == STORAGE_NPOS) return STORAGE_NPOS;
+
+    memcpy(_buffer + moved + sizeof(EntryHeader), _buffer + offset + sizeof(EntryHeader), header.size);
+
+    auto moved_header = _read_header(moved);
+    moved_header.size = header.size;
+    _write_header(moved, moved_header);
+
+    header.key[0] = '\0';
+    header.size = 0;
+    _write_header(offset, header);
+
+    return moved;
+}
+
+StorageArenaBackend::EntryHeader StorageArenaBackend::_read_header(size_t offset) const {
+    EntryHeader header{};
+    memcpy(&header, _buffer + offset, sizeof(header));
+
+    return header;
+}
+
+void StorageArenaBackend::_write_header(size_t offset, const EntryHeader &header) {
+    memcpy(_buffer + offset, &header, sizeof(header));
+}
+
+size_t StorageArenaBackend::_copy_chunks(size_t entry, size_t offset, const StorageChunk *chunks, size_t count) {
+    auto header = _read_header(entry);
+
+    size_t written = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (chunks[i].size > 0) memcpy(_buffer + entry + sizeof(EntryHeader) + offset + written, chunks[i].data, chunks[i].size);
+        written += chunks[i].size;
+    }
+
+    header.size = std::max<size_t>(header.size, offset + written);
+    _write_header(entry, header);
+
+    return written;
+}
+
+#if defined(ARDUINO_ARCH_ESP32)
+// RTC_DATA_ATTR is re-initialized on every boot except wake from deep sleep, RTC_NOINIT_ATTR survives restart too
+static RTC_NOINIT_ATTR uint32_t storage_rtc_buffer[STORAGE_RTC_SIZE / sizeof(uint32_t)];
+#else
+static uint32_t storage_rtc_buffer[STORAGE_RTC_SIZE / sizeof(uint32_t)];
+#endif
+
+StorageRtcBackend::StorageRtcBackend() : StorageArenaBackend((uint8_t *) storage_rtc_buffer, sizeof(storage_rtc_buffer)) {}
+
+void StorageRtcBackend::begin() {
+#ifdef ARDUINO_ARCH_ESP8266
+    ESP.rtcUserMemoryRead(STORAGE_RTC_OFFSET, storage_rtc_buffer, sizeof(storage_rtc_buffer));
+#endif
+
+    StorageArenaBackend::begin();
+}
+
+void StorageRtcBackend::_sync() {
+#ifdef ARDUINO_ARCH_ESP8266
+    ESP.rtcUserMemoryWrite(STORAGE_RTC_OFFSET, storage_rtc_buffer, sizeof(storage_rtc_buffer));
+#endif
+}
+
+#ifdef ARDUINO_ARCH_ESP32
+
+StorageNvsBackend::StorageNvsBackend(const char *ns) : _namespace(ns) {}
+
+StorageNvsBackend::~StorageNvsBackend() {
+    if (_opened) nvs_close(_handle);
+}
+
+bool StorageNvsBackend::begin() {
+    if (_opened) return true;
+
+    const auto ret = nvs_open(_namespace, NVS_READWRITE, &_handle);
+    if (ret != ESP_OK) {
+        D_PRINTF("StorageNvsBackend: Unable to open namespace %s: %s\r\n", _namespace, esp_err_to_name(ret));
+        return false;
+    }
+
+    _opened = true;
+    return true;
+}
+
+bool StorageNvsBackend::exists(const char *key) {
+    return size(key) > 0;
+}
+
+size_t StorageNvsBackend::size(const char *key) {
+    if (!_opened) return 0;
+
+    size_t length = 0;
+    if (nvs_get_blob(_handle, key, nullptr, &length) != ESP_OK) return 0;
+
+    return length;
+}
+
+size_t StorageNvsBackend::read(const char *key, size_t offset, void *data, size_t size) {
+    size_t length = this->size(key);
+    if (length == 0 || offset > length) return 0;
+
+    const size_t result = std::min(size, length - offset);
+    if (offset == 0 && result == length) {
+        return nvs_get_blob(_handle, key, data, &length) == ESP_OK ? result : 0;
+    }
+
+    // NVS can't read blob partially
+    auto *buffer = new uint8_t[length];
+
+    const bool success = nvs_get_blob(_handle, key, buffer, &length) == ESP_OK;
+    if (success) memcpy(data, buffer + offset, result);
+
+    delete[] buffer;
+    return success ? result : 0;
+}
+
+size_t StorageNvsBackend::write(const char *key, const StorageChunk *chunks, size_t count, bool) {
+    if (!_opened) return 0;
+
+    const size_t total = storage_chunks_size(chunks, count);
+    auto *buffer = new uint8_t[total];
+
+    size_t offset = 0;
+    for (size_t i = 0; i < count; ++i) {
+        memcpy(buffer + offset, chunks[i].data, chunks[i].size);
+        offset += chunks[i].size;
+    }
+
+    auto ret = nvs_set_blob(_handle, key, buffer, total);
+    if (ret == ESP_OK) ret = nvs_commit(_handle);
+
+    delete[] buffer;
+
+    if (ret != ESP_OK) {
+        D_PRINTF("StorageNvsBackend: Unable to write %s: %s\r\n", key, esp_err_to_name(ret));
+        return 0;
+    }
+
+    return total;
+}
+
+bool StorageNvsBackend::remove(const char *key) {
+    if (!_opened || nvs_erase_key(_handle, key) != ESP_OK) return false;
+
+    return nvs_commit(_handle) == ESP_OK;
+}
+
+#endif
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifdef ARDUINO_ARCH_ESP32
+#include <nvs.h>
+#endif
+
+#ifndef STORAGE_NVS_NAMESPACE
+#define STORAGE_NVS_NAMESPACE                   ("storage")
+#endif
+#ifndef STORAGE_RTC_SIZE
+#define STORAGE_RTC_SIZE                        (384u)                  // ESP8266 has only 512 bytes of RTC user memory
+#endif
+#ifndef STORAGE_RTC_OFFSET
+#define STORAGE_RTC_OFFSET                      (32u)                   // ESP8266 RTC user memory block, first 128 bytes are used by OTA
+#endif
+#ifndef STORAGE_ARENA_KEY_SIZE
+#define STORAGE_ARENA_KEY_SIZE                  (16u)
+#endif
+
+struct StorageChunk {
+    const void *data;
+    size_t size;
+};
+
+inline size_t storage_chunks_size(const StorageChunk *chunks, size_t count) {
+    size_t result = 0;
+    for (size_t i = 0; i < count; ++i) result += chunks[i].size;
+
+    return result;
+}
+
+/**
+ * Key-value blob storage used by Storage.
+ * Values are written as concatenation of chunks to avoid copying header and data into a single buffer.
+ * Partial writes and appends are optional, Storage falls back to full writes if backend doesn't support them.
+ */
+class StorageBackend {
+public:
+    virtual ~StorageBackend() = default;
+
+    [[nodiscard]] virtual bool exists(const char *key) = 0;
+
+    // Returns 0 if value doesn't exist
+    [[nodiscard]] virtual size_t size(const char *key) = 0;
+
+    // Returns number of read bytes
+    virtual size_t read(const char *key, size_t offset, void *data, size_t size) = 0;
+
+    // Replace whole value. Atomic write keeps the old value if interrupted. Returns number of written bytes
+    virtual size_t write(const char *key, const StorageChunk *chunks, size_t count, bool atomic = false) = 0;
+
+    virtual bool remove(const char *key) = 0;
+
+    // Overwrite bytes of existing value starting from offset
+    [[nodiscard]] virtual bool supports_partial_write() const { return false; }
+    virtual size_t write_at(const char *, size_t, const StorageChunk *, size_t) { return 0; }
+
+    [[nodiscard]] virtual bool supports_append() const { return false; }
+    virtual size_t append(const char *, const StorageChunk *, size_t) { return 0; }
+};
+
+/**
+ * Values are kept in heap, nothing survives restart. Useful for tests and benchmarks, builds without Arduino
+ */
+class StorageMemoryBackend : public StorageBackend {
+    struct Entry {
+        std::string key;
+        std::vector<uint8_t> data;
+    };
+
+    std::vector<Entry> _entries;
+
+public:
+    bool exists(const char *key) override;
+    size_t size(const char *key) override;
+
+    size_t read(const char *key, size_t offset, void *data, size_t size) override;
+    size_t write(const char *key, const StorageChunk *chunks, size_t count, bool atomic) override;
+    bool remove(const char *key) override;
+
+    [[nodiscard]] bool supports_partial_write() const override { return true; }
+    size_t write_at(const char *key, size_t offset, const StorageChunk *chunks, size_t count) override;
+
+    [[nodiscard]] bool supports_append() const override { return true; }
+    size_t append(const char *key, const StorageChunk *chunks, size_t count) override;
+
+    void clear() { _entries.clear(); }
+
+private:
+    Entry *_find(const char *key);
+};
+
+/**
+ * Values are packed into a fixed buffer one after another:
+ * [magic] { [key] [capacity] [size] [data...] } * N
+ * Removed entry keeps its place and can be reused by a value of the same or smaller size.
+ */
+class StorageArenaBackend : public StorageBackend {
+    uint8_t *_buffer;
+    size_t _buffer_size;
+
+public:
+    StorageArenaBackend(uint8_t *buffer, size_t size);
+
+    // Reset arena if it doesn't contain valid data, e.g. after power loss
+    virtual void begin();
+
+    bool exists(const char *key) override;
+    size_t size(const char *key) override;
+
+    size_t read(const char *key, size_t offset, void *data, size_t size) override;
+    size_t write(const char *key, const StorageChunk *chunks, size_t count, bool atomic) override;
+    bool remove(const char *key) override;
+
+    [[nodiscard]] bool supports_partial_write() const override { return true; }
+    size_t write_at(const char *key, size_t offset, const StorageChunk *chunks, size_t count) override;
+
+    [[nodiscard]] bool supports_append() const override { return true; }
+    size_t append(const char *key, const StorageChunk *chunks, size_t count) override;
+
+    [[nodiscard]] size_t free_space() const;
+
+protected:
+    // Called after buffer was modified
+    virtual void _sync() {}
+
+private:
+    struct EntryHeader {
+        char key[STORAGE_ARENA_KEY_SIZE];
+        uint16_t capacity;
+        uint16_t size;
+    };
+
+    [[nodiscard]] size_t _find(const char *key) const;
+    [[nodiscard]] size_t _tail() const;
+    [[nodiscard]] size_t _allocate(const char *key, size_t size);
+    [[nodiscard]] size_t _reserve(size_t offset, size_t size);
+
+    [[nodiscard]] EntryHeader _read_header(size_t offset) const;
+    void _write_header(size_t offset, const EntryHeader &header);
+
+    size_t _copy_chunks(size_t offset, size_t limit, const StorageChunk *chunks, size_t count);
+};
+
+/**
+ * RTC memory survives deep sleep and software restart, but not power loss.
+ * Buffer isn't initialized on boot, so begin() resets it if it doesn't contain valid data.
+ * Allows resuming after deep sleep without FLASH access. Only one instance should be used.
+ */
+class StorageRtcBackend : public StorageArenaBackend {
+public:
+    StorageRtcBackend();
+
+    void begin() override;
+
+protected:
+    void _sync() override;
+};
+
+#ifdef ARDUINO_ARCH_ESP32
+
+/**
+ * ESP32 NVS, writes are atomic and wear-levelled by IDF. Keys are limited to 15 characters
+ */
+class StorageNvsBackend : public StorageBackend {
+    const char *_namespace;
+    nvs_handle_t _handle = 0;
+    bool _opened = false;
+
+public:
+    explicit StorageNvsBackend(const char *ns = STORAGE_NVS_NAMESPACE);
+    ~StorageNvsBackend() override;
+
+    bool begin();
+
+    bool exists(const char *key) override;
+    size_t size(const char *key) override;
+
+    size_t read(const char *key, size_t offset, void *data, size_t size) override;
+    size_t write(const char *key, const StorageChunk *chunks, size_t count, bool atomic) override;
+    bool remove(const char *key) override;
+};
+
+#endif
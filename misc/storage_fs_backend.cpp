@@ -0,0 +1,193 @@
+#include "./storage_fs_backend.h"
+
+#include <algorithm>
+
+#include "../debug.h"
+#include "../utils/crc.h"
+
+StorageFsBackend::StorageFsBackend(FS *fs, const char *root) : _fs(fs), _root(root) {}
+
+bool StorageFsBackend::exists(const char *key) {
+    return _fs->exists(_recover(key));
+}
+
+size_t StorageFsBackend::size(const char *key) {
+    const String path = _recover(key);
+    if (!_fs->exists(path)) return 0;
+
+    auto file = _fs->open(path, "r");
+    const size_t result = file.size();
+    file.close();
+
+    return result;
+}
+
+size_t StorageFsBackend::read(const char *key, size_t offset, void *data, size_t size) {
+    const String path = _recover(key);
+    if (!_fs->exists(path)) return 0;
+
+    auto file = _fs->open(path, "r");
+
+    size_t result = 0;
+    if (file && file.seek(offset)) result = file.read((uint8_t *) data, size);
+
+    file.close();
+    return result;
+}
+
+size_t StorageFsBackend::write(const char *key, const StorageChunk *chunks, size_t count, bool atomic) {
+    const String path = _get_path(key);
+
+    // New file is written aside and replaces the old one, so existing data stays valid until rename
+    const String write_path = atomic ? path + STORAGE_TMP_SUFFIX : path;
+
+    auto file = _open(write_path, "w");
+    size_t written = _write_chunks(file, chunks, count);
+    file.close();
+
+    if (!atomic) return written;
+
+    if (written != storage_chunks_size(chunks, count)) {
+        // Partially written file must never be recovered
+        _fs->remove(write_path);
+        return written;
+    }
+
+    if (!_fs->rename(write_path, path) && !_replace(write_path, path, chunks, count)) written = 0;
+    return written;
+}
+
+size_t StorageFsBackend::write_at(const char *key, size_t offset, const StorageChunk *chunks, size_t count) {
+    auto file = _fs->open(_recover(key), "r+");
+
+    size_t written = 0;
+    if (file && file.seek(offset)) written = _write_chunks(file, chunks, count);
+
+    file.close();
+    return written;
+}
+
+size_t StorageFsBackend::append(const char *key, const StorageChunk *chunks, size_t count) {
+    auto file = _open(_recover(key), "a");
+    const size_t written = _write_chunks(file, chunks, count);
+    file.close();
+
+    return written;
+}
+
+bool StorageFsBackend::remove(const char *key) {
+    const String path = _get_path(key);
+
+    // Leftover of the interrupted write must not be recovered later
+    const String tmp_path = path + STORAGE_TMP_SUFFIX;
+    if (_fs->exists(tmp_path)) _fs->remove(tmp_path);
+
+    const String marker_path = path + STORAGE_COMMIT_SUFFIX;
+    if (_fs->exists(marker_path)) _fs->remove(marker_path);
+
+    if (!_fs->exists(path)) return false;
+
+    return _fs->remove(path);
+}
+
+String StorageFsBackend::_recover(const char *key) {
+    const String path = _get_path(key);
+    if (_fs->exists(path)) return path;
+
+    const String tmp_path = path + STORAGE_TMP_SUFFIX;
+    if (!_fs->exists(tmp_path)) return path;
+
+    // Atomic write was interrupted between removal of the old file and rename of the new one.
+    // Without valid marker temporary file may be incomplete, e.g. first write of the value was interrupted
+    const String marker_path = path + STORAGE_COMMIT_SUFFIX;
+    if (_verify(tmp_path, marker_path)) {
+        D_PRINTF("StorageFsBackend: Recover %s from interrupted write\r\n", path.c_str());
+        _fs->rename(tmp_path, path);
+    } else {
+        D_PRINTF("StorageFsBackend: Drop incomplete write of %s\r\n", path.c_str());
+        _fs->remove(tmp_path);
+    }
+
+    if (_fs->exists(marker_path)) _fs->remove(marker_path);
+    return path;
+}
+
+bool StorageFsBackend::_verify(const String &tmp_path, const String &marker_path) {
+    if (!_fs->exists(marker_path)) return false;
+
+    CommitMarker marker{};
+
+    auto file = _fs->open(marker_path, "r");
+    const bool marker_valid = file && file.read((uint8_t *) &marker, sizeof(marker)) == sizeof(marker);
+    file.close();
+
+    if (!marker_valid) return false;
+
+    file = _fs->open(tmp_path, "r");
+    if (!file || file.size() != marker.size) {
+        file.close();
+        return false;
+    }
+
+    uint8_t buffer[64];
+    uint32_t crc = 0;
+
+    size_t remaining = marker.size;
+    while (remaining > 0) {
+        const size_t read = file.read(buffer, std::min(remaining, sizeof(buffer)));
+        if (read == 0) break;
+
+        crc = crc32_calc(buffer, read, crc);
+        remaining -= read;
+    }
+
+    file.close();
+    return remaining == 0 && crc == marker.crc;
+}
+
+bool StorageFsBackend::_replace(const String &tmp_path, const String &path, const StorageChunk *chunks, size_t count) {
+    // Some filesystems can't rename over existing file, so there is a moment when only the temporary file exists.
+    // Marker proves it was completely written before the old value is removed
+    CommitMarker marker{(uint32_t) storage_chunks_size(chunks, count), 0};
+    for (size_t i = 0; i < count; ++i) marker.crc = crc32_calc(chunks[i].data, chunks[i].size, marker.crc);
+
+    const String marker_path = path + STORAGE_COMMIT_SUFFIX;
+    const StorageChunk marker_chunk{&marker, sizeof(marker)};
+
+    auto file = _open(marker_path, "w");
+    const bool marker_written = _write_chunks(file, &marker_chunk, 1) == sizeof(marker);
+    file.close();
+
+    if (!marker_written) {
+        _fs->remove(marker_path);
+        _fs->remove(tmp_path);
+
+        return false;
+    }
+
+    _fs->remove(path);
+    if (!_fs->rename(tmp_path, path)) return false;
+
+    // Marker is kept on failure, so the value is recovered on the next access
+    _fs->remove(marker_path);
+    return true;
+}
+
+File StorageFsBackend::_open(const String &path, const char *mode) {
+#ifdef ESP32
+    return _fs->open(path, mode, true);
+#else
+    return _fs->open(path, mode);
+#endif
+}
+
+size_t StorageFsBackend::_write_chunks(File &file, const StorageChunk *chunks, size_t count) {
+    if (!file) return 0;
+
+    size_t written = 0;
+    for (size_t i = 0; i < count; ++i) {
+        written += file.write((const uint8_t *) chunks[i].data, chunks[i].size);
+    }
+
+    return written;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include "./storage_backend.h"
+
+#ifndef STORAGE_PATH
+#define STORAGE_PATH                            ("/__storage/")
+#endif
+#ifndef STORAGE_TMP_SUFFIX
+#define STORAGE_TMP_SUFFIX                      (".tmp")
+#endif
+#ifndef STORAGE_COMMIT_SUFFIX
+#define STORAGE_COMMIT_SUFFIX                   (".commit")             // Marker of the temporary file which replaces removed value
+#endif
+
+/**
+ * Files under the root directory of the filesystem (LittleFS)
+ */
+class StorageFsBackend : public StorageBackend {
+    struct CommitMarker {
+        uint32_t size;
+        uint32_t crc;
+    };
+
+    FS *_fs;
+    const char *_root;
+
+public:
+    explicit StorageFsBackend(FS *fs, const char *root = STORAGE_PATH);
+
+    [[nodiscard]] inline FS *fs() const { return _fs; }
+
+    bool exists(const char *key) override;
+    size_t size(const char *key) override;
+
+    size_t read(const char *key, size_t offset, void *data, size_t size) override;
+    size_t write(const char *key, const StorageChunk *chunks, size_t count, bool atomic) override;
+    bool remove(const char *key) override;
+
+    [[nodiscard]] bool supports_partial_write() const override { return true; }
+    size_t write_at(const char *key, size_t offset, const StorageChunk *chunks, size_t count) override;
+
+    [[nodiscard]] bool supports_append() const override { return true; }
+    size_t append(const char *key, const StorageChunk *chunks, size_t count) override;
+
+private:
+    [[nodiscard]] inline String _get_path(const char *key) const { return String(_root) + key; }
+
+    // Path of the value, restored from temporary file if atomic write was interrupted
+    String _recover(const char *key);
+
+    // Temporary file is promoted only if it matches the commit marker written before removal of the old value
+    bool _verify(const String &tmp_path, const String &marker_path);
+    bool _replace(const String &tmp_path, const String &path, const StorageChunk *chunks, size_t count);
+
+    File _open(const String &path, const char *mode);
+    static size_t _write_chunks(File &file, const StorageChunk *chunks, size_t count);
+};
@@ -0,0 +1,188 @@
+#include "./storage_manager.h"
+
+#include <algorithm>
+#include <cstring>
+
+void StorageBase::_request_commit() {
+    if (_manager) _manager->_on_change();
+}
+
+void StorageBase::_request_retry(unsigned long delay) {
+    if (_manager) _manager->_schedule_commit(delay, false);
+}
+
+StorageManager::StorageManager(Timer &timer) : _timer(timer) {}
+
+StorageManager::~StorageManager() {
+    if (_commit_timer_id != TIMER_INVALID_ID) _timer.clear_timeout(_commit_timer_id);
+}
+
+void StorageManager::begin(FS *fs) {
+    _fs_backend = std::make_unique<StorageFsBackend>(fs);
+    begin(_fs_backend.get());
+}
+
+void StorageManager::begin(StorageBackend *backend) {
+    _backend = backend;
+
+    // Managed, so its commits are retried by the pass and never charge the policy on their own
+    _stats_storage = std::make_unique<Storage<StorageStats>>(_timer, STORAGE_STATS_KEY);
+    _stats_storage->_manager = this;
+    _stats_storage->begin(_backend);
+    _stats_base = _stats_storage->get();
+
+    for (auto &storage: _storages) {
+        storage->begin(_backend);
+    }
+}
+
+StorageBase *StorageManager::find(const char *key) const {
+    for (auto &storage: _storages) {
+        if (strcmp(storage->key(), key) == 0) return storage.get();
+    }
+
+    return nullptr;
+}
+
+bool StorageManager::is_pending_commit() const {
+    for (auto &storage: _storages) {
+        if (storage->is_pending_commit()) return true;
+    }
+
+    return false;
+}
+
+static void storage_stats_add(StorageStats &result, const StorageStats &stats) {
+    result.commits += stats.commits;
+    result.skipped += stats.skipped;
+    result.failed += stats.failed;
+    result.bytes_written += stats.bytes_written;
+}
+
+StorageStats StorageManager::stats() const {
+    StorageStats result{};
+    for (auto &storage: _storages) {
+        storage_stats_add(result, storage->stats());
+    }
+
+    if (_stats_storage) storage_stats_add(result, _stats_storage->stats());
+    return result;
+}
+
+StorageStats StorageManager::total_stats() const {
+    StorageStats result = _stats_base;
+    storage_stats_add(result, stats());
+
+    return result;
+}
+
+void StorageManager::set_flush_policy(StorageFlushPolicy *policy) {
+    _policy = policy;
+
+    for (auto &storage: _storages) {
+        storage->_policy = _policy;
+    }
+}
+
+size_t StorageManager::flush() {
+    if (_commit_timer_id != TIMER_INVALID_ID) {
+        _timer.clear_timeout(_commit_timer_id);
+        _commit_timer_id = TIMER_INVALID_ID;
+    }
+
+    _change_pending = false;
+
+    size_t count = 0;
+    for (auto &storage: _storages) {
+        // force_save() supersedes queued async commit or follows the running one
+        if (!storage->is_pending_commit() && !storage->is_commit_in_progress()) continue;
+
+        storage->force_save();
+        count++;
+    }
+
+    if (_stats_storage && (stats().commits != _persisted_commits || _stats_storage->is_pending_commit())) {
+        _persist_stats(true);
+    }
+
+    D_PRINTF("StorageManager: Flushed %u storages\r\n", count);
+    return count;
+}
+
+void StorageManager::_on_change() {
+    const auto now = millis();
+    if (_policy) {
+        _schedule_commit(_policy->on_change(now), true);
+        return;
+    }
+
+    if (!_change_pending) {
+        _change_pending = true;
+        _first_change = now;
+    }
+
+    // Every change restarts the window, so a series of changes is written once, but frequent changes can't postpone it forever
+    const unsigned long left = STORAGE_SAVE_MAX_DELAY - std::min<unsigned long>(now - _first_change, STORAGE_SAVE_MAX_DELAY);
+    _schedule_commit(std::min<unsigned long>(STORAGE_SAVE_INTERVAL, left), true);
+}
+
+void StorageManager::_schedule_commit(unsigned long delay, bool reschedule) {
+    if (_commit_timer_id != TIMER_INVALID_ID) {
+        if (!reschedule) return;
+
+        _timer.clear_timeout(_commit_timer_id);
+    }
+
+    D_PRINTF("StorageManager: Schedule commit in %lu ms...\r\n", delay);
+    _commit_timer_id = _timer.add_timeout([](void *param) {
+        auto *self = (StorageManager *) param;
+        self->_commit_timer_id = TIMER_INVALID_ID;
+        self->_commit_pending();
+    }, delay, this);
+
+    _timer.set_slack(_commit_timer_id, STORAGE_SAVE_SLACK);
+}
+
+void StorageManager::_commit_pending() {
+    _change_pending = false;
+
+    if (_policy) {
+        _policy->on_commit();
+
+        // Instances are committed in a single pass, so the pass consumes one write of the budget
+        bool changed = _stats_storage && _stats_storage->is_pending_commit();
+        for (auto &storage: _storages) {
+            if (storage->is_pending_commit() && storage->_is_commit_needed()) {
+                changed = true;
+                break;
+            }
+        }
+
+        const unsigned long wait = changed ? _policy->acquire_write(millis()) : 0;
+        if (wait > 0) {
+            _schedule_commit(wait, true);
+            return;
+        }
+    }
+
+    for (auto &storage: _storages) {
+        if (storage->is_pending_commit()) storage->_commit_scheduled();
+    }
+
+    if (!_stats_storage) return;
+
+    // Failed write of the counters is retried by the next pass
+    if (_stats_storage->is_pending_commit() || stats().commits - _persisted_commits >= STORAGE_STATS_PERSIST_COMMITS) {
+        _persist_stats(false);
+    }
+}
+
+void StorageManager::_persist_stats(bool force) {
+    _stats_storage->get() = total_stats();
+
+    // Managed commit is a part of the pass, which already acquired the write budget
+    if (force) _stats_storage->force_save();
+    else ((StorageBase &) *_stats_storage)._commit_scheduled();
+
+    _persisted_commits = stats().commits;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "./storage.h"
+#include "./storage_policy.h"
+#include "./timer.h"
+#include "../debug.h"
+
+#ifndef STORAGE_STATS_KEY
+#define STORAGE_STATS_KEY                       ("__storage_stats")
+#endif
+#ifndef STORAGE_STATS_PERSIST_COMMITS
+#define STORAGE_STATS_PERSIST_COMMITS           (16u)                   // Commits between persisting write counters
+#endif
+
+/**
+ * Owns Storage instances and commits all changed ones in a single pass using one shared timer.
+ * Storage created by the manager doesn't schedule its own commit, save() only marks it as changed.
+ */
+class StorageManager {
+    friend class StorageBase;
+
+    Timer &_timer;
+
+    StorageBackend *_backend = nullptr;
+    std::unique_ptr<StorageFsBackend> _fs_backend = nullptr;
+
+    std::vector<std::unique_ptr<StorageBase>> _storages;
+    TimerId _commit_timer_id = TIMER_INVALID_ID;
+
+    bool _change_pending = false;
+    unsigned long _first_change = 0;
+
+    StorageFlushPolicy *_policy = nullptr;
+
+    // Write counters of previous boots, persisted separately from managed instances
+    std::unique_ptr<Storage<StorageStats>> _stats_storage = nullptr;
+    StorageStats _stats_base{};
+    uint32_t _persisted_commits = 0;
+
+public:
+    explicit StorageManager(Timer &timer);
+    ~StorageManager();
+
+    StorageManager(const StorageManager &) = delete;
+    StorageManager &operator=(const StorageManager &) = delete;
+
+    // Load all created instances, instances created later are loaded immediately
+    void begin(FS *fs);
+
+    // Backend isn't owned by the manager, all instances and write counters share it
+    void begin(StorageBackend *backend);
+
+    template<typename T>
+    Storage<T> &create(const char *key, uint8_t version = 1, uint32_t header = 0xd0c1f2c3,
+                       StorageMode mode = StorageMode::FULL);
+
+    [[nodiscard]] StorageBase *find(const char *key) const;
+
+    [[nodiscard]] inline size_t count() const { return _storages.size(); }
+    [[nodiscard]] inline Timer &timer() const { return _timer; }
+
+    [[nodiscard]] bool is_pending_commit() const;
+
+    // Counters since boot
+    [[nodiscard]] StorageStats stats() const;
+
+    // Counters over device lifetime, persisted every STORAGE_STATS_PERSIST_COMMITS commits and on flush()
+    [[nodiscard]] StorageStats total_stats() const;
+
+    // Policy is applied to all managed instances, write budget is charged once per commit pass rather than per instance.
+    // Without policy commit is performed once changes settle for STORAGE_SAVE_INTERVAL,
+    // but no later than STORAGE_SAVE_MAX_DELAY after the first change
+    void set_flush_policy(StorageFlushPolicy *policy);
+    [[nodiscard]] inline StorageFlushPolicy *flush_policy() const { return _policy; }
+
+    // Commit all changed instances immediately ignoring write budget, e.g. before restart. Returns number of committed instances
+    size_t flush();
+
+private:
+    void _on_change();
+    void _schedule_commit(unsigned long delay, bool reschedule);
+    void _commit_pending();
+    void _persist_stats(bool force);
+};
+
+template<typename T>
+Storage<T> &StorageManager::create(const char *key, uint8_t version, uint32_t header, StorageMode mode) {
+    auto *storage = new Storage<T>(_timer, key, version, header, mode);
+    storage->_manager = this;
+    storage->_policy = _policy;
+
+    _storages.emplace_back(storage);
+    if (_backend) storage->begin(_backend);
+
+    return *storage;
+}
@@ -0,0 +1,81 @@
+#include "./storage_policy.h"
+
+#include <algorithm>
+
+#include "../debug.h"
+
+static constexpr unsigned long STORAGE_POLICY_HOUR = 3600000ul;
+
+StorageFlushPolicy::StorageFlushPolicy(unsigned long min_delay, unsigned long max_delay, uint16_t max_writes_per_hour) :
+        _min_delay(min_delay), _max_delay(std::max(min_delay, max_delay)), _max_writes_per_hour(max_writes_per_hour),
+        _credit(STORAGE_POLICY_HOUR) {}
+
+unsigned long StorageFlushPolicy::on_change(unsigned long now) {
+    if (_has_change) {
+        const unsigned long interval = now - _last_change;
+
+        // Long pause means previous changes are finished, so rate is measured from scratch
+        if (interval >= _max_delay) {
+            _avg_interval = 0;
+        } else if (_avg_interval == 0) {
+            _avg_interval = interval;
+        } else {
+            _avg_interval = (_avg_interval * 3 + interval) / 4;
+        }
+    }
+
+    _has_change = true;
+    _last_change = now;
+
+    if (!_pending) {
+        _pending = true;
+        _first_change = now;
+    }
+
+    const unsigned long quiet = std::min(std::max(_avg_interval * STORAGE_POLICY_RATE_FACTOR, _min_delay), _max_delay);
+    const unsigned long left = _max_delay - std::min(now - _first_change, _max_delay);
+
+    const unsigned long delay = std::min(quiet, left);
+    VERBOSE(D_PRINTF("StorageFlushPolicy: change interval %lu, commit delay %lu\r\n", _avg_interval, delay));
+
+    return delay;
+}
+
+void StorageFlushPolicy::on_commit() {
+    _pending = false;
+}
+
+unsigned long StorageFlushPolicy::acquire_write(unsigned long now) {
+    if (_max_writes_per_hour == 0) return 0;
+
+    _refill(now);
+
+    const unsigned long cost = _write_cost();
+    if (_credit >= cost) {
+        _credit -= cost;
+        return 0;
+    }
+
+    _deferred++;
+
+    D_PRINTF("StorageFlushPolicy: Write budget exhausted, wait %lu ms\r\n", cost - _credit);
+    return cost - _credit;
+}
+
+uint16_t StorageFlushPolicy::available_writes(unsigned long now) {
+    if (_max_writes_per_hour == 0) return UINT16_MAX;
+
+    _refill(now);
+    return _credit / _write_cost();
+}
+
+void StorageFlushPolicy::_refill(unsigned long now) {
+    const unsigned long elapsed = now - _last_refill;
+    _last_refill = now;
+
+    _credit += std::min(STORAGE_POLICY_HOUR - _credit, elapsed);
+}
+
+unsigned long StorageFlushPolicy::_write_cost() const {
+    return STORAGE_POLICY_HOUR / _max_writes_per_hour;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+
+#ifndef STORAGE_POLICY_MIN_DELAY
+#define STORAGE_POLICY_MIN_DELAY                (5000u)                 // Commit delay after a single change
+#endif
+#ifndef STORAGE_POLICY_MAX_DELAY
+#define STORAGE_POLICY_MAX_DELAY                (300000u)               // Max delay since the first uncommitted change
+#endif
+#ifndef STORAGE_POLICY_RATE_FACTOR
+#define STORAGE_POLICY_RATE_FACTOR              (3u)                    // Wait this many average change intervals without changes
+#endif
+#ifndef STORAGE_POLICY_MAX_WRITES_PER_HOUR
+#define STORAGE_POLICY_MAX_WRITES_PER_HOUR      (60u)                   // 0 - unlimited
+#endif
+
+/**
+ * Adaptive commit delay with write budget.
+ *
+ * Commit is postponed until changes settle: delay grows with the observed change rate,
+ * so a slider dragged by user is committed once, while a single change is committed after min_delay.
+ * Delay never exceeds max_delay since the first uncommitted change.
+ *
+ * Writes are limited by a token bucket which allows max_writes_per_hour on average and bursts up to the same amount.
+ */
+class StorageFlushPolicy {
+    unsigned long _min_delay;
+    unsigned long _max_delay;
+    uint16_t _max_writes_per_hour;
+
+    bool _has_change = false;
+    unsigned long _last_change = 0;
+    unsigned long _avg_interval = 0;
+
+    bool _pending = false;
+    unsigned long _first_change = 0;
+
+    unsigned long _credit;
+    unsigned long _last_refill = 0;
+
+    uint32_t _deferred = 0;
+
+public:
+    explicit StorageFlushPolicy(unsigned long min_delay = STORAGE_POLICY_MIN_DELAY,
+                                unsigned long max_delay = STORAGE_POLICY_MAX_DELAY,
+                                uint16_t max_writes_per_hour = STORAGE_POLICY_MAX_WRITES_PER_HOUR);
+
+    // Register data change, returns delay before commit
+    unsigned long on_change(unsigned long now);
+
+    // Register commit attempt, next change starts a new window
+    void on_commit();
+
+    // Returns 0 if write is allowed (consumes budget), otherwise time until budget allows it
+    unsigned long acquire_write(unsigned long now);
+
+    [[nodiscard]] inline unsigned long average_interval() const { return _avg_interval; }
+    [[nodiscard]] inline uint32_t deferred() const { return _deferred; }
+
+    [[nodiscard]] uint16_t available_writes(unsigned long now);
+
+private:
+    void _refill(unsigned long now);
+    [[nodiscard]] unsigned long _write_cost() const;
+};
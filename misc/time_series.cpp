@@ -0,0 +1,577 @@
+#include "./time_series.h"
+
+#include "../debug.h"
+#include "../utils/crc.h"
+
+static size_t put_varint(uint8_t *ptr, uint64_t value) {
+    size_t size = 0;
+    while (value >= 0x80) {
+        ptr[size++] = (uint8_t) (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+
+    ptr[size++] = (uint8_t) value;
+    return size;
+}
+
+static bool get_varint(const uint8_t *ptr, size_t size, size_t &position, uint64_t &out_value) {
+    out_value = 0;
+    for (uint8_t shift = 0; position < size && shift < 64; shift += 7) {
+        const uint8_t byte = ptr[position++];
+        out_value |= (uint64_t) (byte & 0x7f) << shift;
+
+        if ((byte & 0x80) == 0) return true;
+    }
+
+    return false;
+}
+
+static inline uint64_t zigzag_encode(int64_t value) {
+    return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+static inline int64_t zigzag_decode(uint64_t value) {
+    return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+TimeSeriesCursor::TimeSeriesCursor(const TimeSeriesStore &store, uint8_t tier, uint32_t from, uint32_t to) :
+    _store(store), _tier(store._tiers[tier]), _index(tier), _from(from), _to(to) {
+    // Rows of the segment are older than the start of the next one
+    while (_segment + 1 < _tier.count && _tier.starts[_segment + 1] <= from) _segment++;
+}
+
+bool TimeSeriesCursor::next(uint32_t &out_timestamp, int32_t *out_values) {
+    if (!_opened) {
+        _opened = true;
+        if (!_open_segment()) return false;
+    }
+
+    const size_t count = _store._series.size();
+    while (true) {
+        if (_block_position < _block_size) {
+            if (!TimeSeriesStore::_decode_row(_block, _block_size, _block_position, _row, count)) {
+                _block_position = _block_size;
+                continue;
+            }
+
+            if (_row.timestamp > _to) return false;
+            if (_row.timestamp < _from) continue;
+
+            out_timestamp = _row.timestamp;
+            memcpy(out_values, _row.values, count * sizeof(int32_t));
+
+            return true;
+        }
+
+        if (_read_block()) continue;
+        if (_pending) return false;
+
+        _segment++;
+        if (!_open_segment()) return false;
+    }
+}
+
+bool TimeSeriesCursor::_open_segment() {
+    _block_size = 0;
+    _block_position = 0;
+
+    for (; _segment < _tier.count; ++_segment) {
+        if (_tier.starts[_segment] > _to) return false;
+
+        const uint16_t id = _tier.first_id + _segment;
+
+        uint32_t start;
+        if (!_store._read_segment_header(_index, id, start)) continue;
+
+        _position = TIME_SERIES_SEGMENT_HEADER_SIZE;
+        _segment_size = _store._backend->size(_store._segment_key(_index, id).c_str());
+
+        _row = {};
+        _row.timestamp = start;
+
+        return true;
+    }
+
+    return false;
+}
+
+bool TimeSeriesCursor::_read_block() {
+    if (_pending) return false;
+
+    _block_size = 0;
+    _block_position = 0;
+
+    const String key = _store._segment_key(_index, _tier.first_id + _segment);
+
+    if (_position + TIME_SERIES_BLOCK_HEADER_SIZE <= _segment_size) {
+        uint8_t header[TIME_SERIES_BLOCK_HEADER_SIZE];
+        if (_store._backend->read(key.c_str(), _position, header, sizeof(header)) != sizeof(header)) return false;
+
+        uint16_t size;
+        uint32_t crc;
+
+        memcpy(&size, header, sizeof(size));
+        memcpy(&crc, header + sizeof(size), sizeof(crc));
+
+        // Broken tail ends the segment
+        if (size > sizeof(_block) - TIME_SERIES_BLOCK_HEADER_SIZE
+            || _position + TIME_SERIES_BLOCK_HEADER_SIZE + size > _segment_size
+            || _store._backend->read(key.c_str(), _position + sizeof(header), _block, size) != size
+            || crc32_calc(_block, size) != crc) {
+            return false;
+        }
+
+        _position += TIME_SERIES_BLOCK_HEADER_SIZE + size;
+        _block_size = size;
+
+        return true;
+    }
+
+    // Rows which aren't written yet continue the last segment
+    if (_segment + 1 == _tier.count && _tier.block_size > 0 && !_tier.broken) {
+        memcpy(_block, _tier.block, _tier.block_size);
+
+        _block_size = _tier.block_size;
+        _pending = true;
+
+        return true;
+    }
+
+    return false;
+}
+
+TimeSeriesStore::TimeSeriesStore(Timer &timer, const char *name, unsigned long interval, uint16_t max_segments) :
+    _timer(timer), _name(name), _interval(interval) {
+    _tiers.emplace_back(0, max_segments);
+}
+
+TimeSeriesStore::~TimeSeriesStore() {
+    if (_sample_timer_id != TIMER_INVALID_ID) _timer.clear_interval(_sample_timer_id);
+
+    flush();
+    if (_flush_timer_id != TIMER_INVALID_ID) _timer.clear_timeout(_flush_timer_id);
+}
+
+bool TimeSeriesStore::add_tier(uint32_t resolution, uint16_t max_segments) {
+    if (_backend || _tiers.size() >= TIME_SERIES_MAX_TIERS || resolution <= _tiers.back().resolution) return false;
+
+    _tiers.emplace_back(resolution, max_segments);
+    return true;
+}
+
+bool TimeSeriesStore::begin(FS *fs) {
+    _fs_backend = std::make_unique<StorageFsBackend>(fs);
+    return begin(_fs_backend.get());
+}
+
+bool TimeSeriesStore::begin(StorageBackend *backend) {
+    if (!backend->supports_append()) {
+        D_PRINTF("TimeSeriesStore(%s): Backend doesn't support appends\r\n", _name);
+        return false;
+    }
+
+    _backend = backend;
+
+    if (_load_manifest()) {
+        for (uint8_t tier = 0; tier < _tiers.size(); ++tier) _load_tier(tier);
+    }
+
+    D_PRINTF("TimeSeriesStore(%s): Loaded %u series, %u tiers\r\n", _name, _series.size(), _tiers.size());
+
+    _sample_timer_id = _timer.add_interval([this](void *) { sample(); }, _interval);
+    return true;
+}
+
+void TimeSeriesStore::sample() {
+    const uint32_t timestamp = _clock ? _clock() : 0;
+    if (timestamp == 0) {
+        VERBOSE(D_PRINTF("TimeSeriesStore(%s): Time isn't available, skip sample\r\n", _name));
+        return;
+    }
+
+    sample(timestamp);
+}
+
+void TimeSeriesStore::sample(uint32_t timestamp) {
+    if (!_backend || _series.empty()) return;
+
+    // Checked before any tier is touched, so rejected sample doesn't get into the averages either
+    const auto &raw = _tiers[0];
+    if (raw.count > 0 && timestamp <= raw.last.timestamp) {
+        VERBOSE(D_PRINTF("TimeSeriesStore(%s): Sample %u is older than the last one, skip\r\n", _name, timestamp));
+        return;
+    }
+
+    int32_t values[TIME_SERIES_MAX_SERIES];
+    for (size_t i = 0; i < _series.size(); ++i) {
+        values[i] = _series[i].read(_series[i].parameter->get_value(), _series[i].scale);
+    }
+
+    _append(0, timestamp, values);
+
+    for (uint8_t tier = 1; tier < _tiers.size(); ++tier) _accumulate(tier, timestamp, values);
+}
+
+bool TimeSeriesStore::flush() {
+    if (_flush_timer_id != TIMER_INVALID_ID) {
+        _timer.clear_timeout(_flush_timer_id);
+        _flush_timer_id = TIMER_INVALID_ID;
+    }
+
+    if (!_backend) return true;
+
+    bool success = true;
+    for (uint8_t tier = 0; tier < _tiers.size(); ++tier) success &= _flush_tier(tier);
+
+    return success;
+}
+
+uint32_t TimeSeriesStore::oldest(uint8_t tier) const {
+    return _tiers[tier].count > 0 ? _tiers[tier].starts.front() : 0;
+}
+
+uint8_t TimeSeriesStore::pick_tier(uint32_t from) const {
+    uint8_t result = 0;
+    uint32_t result_oldest = 0;
+
+    for (uint8_t tier = 0; tier < _tiers.size(); ++tier) {
+        const uint32_t tier_oldest = oldest(tier);
+        if (tier_oldest == 0) continue;
+        if (tier_oldest <= from) return tier;
+
+        // Neither tier covers the start, so the one with the longest history is used
+        if (result_oldest == 0 || tier_oldest < result_oldest) {
+            result = tier;
+            result_oldest = tier_oldest;
+        }
+    }
+
+    return result;
+}
+
+bool TimeSeriesStore::_load_manifest() {
+    // Manifest: [magic] [tier count] { [first segment id] [segment count] } * tier count [crc]
+    if (!_backend->exists(_name)) return false;
+
+    uint8_t buffer[sizeof(uint32_t) + sizeof(uint8_t) + 2 * sizeof(uint16_t) * TIME_SERIES_MAX_TIERS + sizeof(uint32_t)];
+
+    const size_t size = _backend->size(_name);
+    if (size > sizeof(buffer) || _backend->read(_name, 0, buffer, size) != size) {
+        D_PRINTF("TimeSeriesStore(%s): Unable to read manifest\r\n", _name);
+        return false;
+    }
+
+    uint32_t magic = 0, crc = 0;
+    const uint8_t tier_count = size > sizeof(magic) ? buffer[sizeof(magic)] : 0;
+
+    if (size >= sizeof(magic)) memcpy(&magic, buffer, sizeof(magic));
+    if (size >= sizeof(crc)) memcpy(&crc, buffer + size - sizeof(crc), sizeof(crc));
+
+    const size_t expected_size = sizeof(magic) + sizeof(tier_count) + 2 * sizeof(uint16_t) * tier_count + sizeof(crc);
+    if (magic != TIME_SERIES_MAGIC || size != expected_size || crc != crc32_calc(buffer, size - sizeof(crc))) {
+        D_PRINTF("TimeSeriesStore(%s): Manifest is corrupted\r\n", _name);
+        return false;
+    }
+
+    // Tiers removed from configuration are ignored, new ones start empty
+    const uint8_t *ptr = buffer + sizeof(magic) + sizeof(tier_count);
+    for (uint8_t tier = 0; tier < tier_count && tier < _tiers.size(); ++tier) {
+        memcpy(&_tiers[tier].first_id, ptr, sizeof(uint16_t));
+        memcpy(&_tiers[tier].count, ptr + sizeof(uint16_t), sizeof(uint16_t));
+
+        ptr += 2 * sizeof(uint16_t);
+    }
+
+    return true;
+}
+
+bool TimeSeriesStore::_write_manifest() {
+    uint8_t buffer[sizeof(uint32_t) + sizeof(uint8_t) + 2 * sizeof(uint16_t) * TIME_SERIES_MAX_TIERS];
+
+    const uint32_t magic = TIME_SERIES_MAGIC;
+    memcpy(buffer, &magic, sizeof(magic));
+    buffer[sizeof(magic)] = (uint8_t) _tiers.size();
+
+    size_t size = sizeof(magic) + sizeof(uint8_t);
+    for (auto &tier: _tiers) {
+        memcpy(buffer + size, &tier.first_id, sizeof(uint16_t));
+        memcpy(buffer + size + sizeof(uint16_t), &tier.count, sizeof(uint16_t));
+
+        size += 2 * sizeof(uint16_t);
+    }
+
+    const uint32_t crc = crc32_calc(buffer, size);
+    const StorageChunk chunks[] = {
+        {buffer, size},
+        {&crc, sizeof(crc)},
+    };
+
+    if (_backend->write(_name, chunks, std::size(chunks), true) != size + sizeof(crc)) {
+        D_PRINTF("TimeSeriesStore(%s): Unable to write manifest\r\n", _name);
+        return false;
+    }
+
+    return true;
+}
+
+void TimeSeriesStore::_load_tier(uint8_t index) {
+    auto &tier = _tiers[index];
+    if (tier.count == 0) return;
+
+    // Missing segment keeps start times ordered, it's skipped by queries
+    tier.starts.resize(tier.count);
+    for (uint16_t i = 0; i < tier.count; ++i) {
+        uint32_t start;
+        const bool valid = _read_segment_header(index, tier.first_id + i, start);
+
+        tier.starts[i] = valid ? start : (i > 0 ? tier.starts[i - 1] : 0);
+        if (i + 1 == tier.count) tier.broken = !valid;
+    }
+
+    if (tier.broken) return;
+
+    // Replay the last segment to restore the delta encoder state
+    const String key = _segment_key(index, tier.first_id + tier.count - 1);
+    tier.segment_size = _backend->size(key.c_str());
+
+    tier.last = {};
+    tier.last.timestamp = tier.starts.back();
+
+    uint32_t position = TIME_SERIES_SEGMENT_HEADER_SIZE;
+    while (position < tier.segment_size) {
+        uint8_t header[TIME_SERIES_BLOCK_HEADER_SIZE];
+        if (position + sizeof(header) > tier.segment_size
+            || _backend->read(key.c_str(), position, header, sizeof(header)) != sizeof(header)) break;
+
+        uint16_t size;
+        uint32_t crc;
+
+        memcpy(&size, header, sizeof(size));
+        memcpy(&crc, header + sizeof(size), sizeof(crc));
+
+        // Block buffer is empty while loading
+        if (size > sizeof(tier.block) - TIME_SERIES_BLOCK_HEADER_SIZE
+            || position + sizeof(header) + size > tier.segment_size
+            || _backend->read(key.c_str(), position + sizeof(header), tier.block, size) != size
+            || crc32_calc(tier.block, size) != crc) break;
+
+        size_t block_position = 0;
+        while (block_position < size) {
+            if (!_decode_row(tier.block, size, block_position, tier.last, _series.size())) break;
+        }
+
+        position += sizeof(header) + size;
+    }
+
+    if (position != tier.segment_size) {
+        D_PRINTF("TimeSeriesStore(%s): Tier %u segment is broken at %u\r\n", _name, index, position);
+        tier.broken = true;
+    }
+
+    VERBOSE(D_PRINTF("TimeSeriesStore(%s): Tier %u has %u segments, last timestamp %u\r\n",
+        _name, index, tier.count, tier.last.timestamp));
+}
+
+void TimeSeriesStore::_append(uint8_t index, uint32_t timestamp, const int32_t *values) {
+    auto &tier = _tiers[index];
+    if (tier.count > 0 && timestamp <= tier.last.timestamp) {
+        VERBOSE(D_PRINTF("TimeSeriesStore(%s): Sample %u is older than the last one, skip\r\n", _name, timestamp));
+        return;
+    }
+
+    const size_t count = _series.size();
+
+    uint8_t row[TIME_SERIES_ROW_MAX_SIZE];
+    size_t size = 0;
+
+    bool fresh = tier.count == 0 || tier.broken;
+    if (!fresh) {
+        size = _encode_row(row, tier.last, timestamp, values, count);
+
+        if (TIME_SERIES_BLOCK_HEADER_SIZE + tier.block_size + size > TIME_SERIES_BLOCK_SIZE) {
+            fresh = !_flush_tier(index);
+        }
+
+        if (tier.segment_size + TIME_SERIES_BLOCK_HEADER_SIZE + tier.block_size + size > TIME_SERIES_SEGMENT_SIZE) {
+            fresh = true;
+        }
+    }
+
+    if (fresh) {
+        _flush_tier(index);
+        if (!_open_segment(index, timestamp)) return;
+
+        size = _encode_row(row, tier.last, timestamp, values, count);
+    }
+
+    memcpy(tier.block + tier.block_size, row, size);
+    tier.block_size += size;
+
+    tier.last.timestamp = timestamp;
+    memcpy(tier.last.values, values, count * sizeof(int32_t));
+
+    _schedule_flush();
+}
+
+void TimeSeriesStore::_accumulate(uint8_t index, uint32_t timestamp, const int32_t *values) {
+    auto &tier = _tiers[index];
+    const uint32_t bucket = timestamp / tier.resolution;
+
+    if (tier.samples > 0 && bucket != tier.bucket) {
+        int32_t average[TIME_SERIES_MAX_SERIES];
+        for (size_t i = 0; i < _series.size(); ++i) {
+            average[i] = (int32_t) std::lround((double) tier.sums[i] / tier.samples);
+        }
+
+        _append(index, tier.bucket * tier.resolution, average);
+
+        tier.samples = 0;
+        memset(tier.sums, 0, sizeof(tier.sums));
+    }
+
+    tier.bucket = bucket;
+    tier.samples++;
+
+    for (size_t i = 0; i < _series.size(); ++i) tier.sums[i] += values[i];
+}
+
+bool TimeSeriesStore::_open_segment(uint8_t index, uint32_t timestamp) {
+    auto &tier = _tiers[index];
+
+    // Retention: the oldest segment is removed after manifest stops referencing it
+    const bool evict = tier.count >= tier.max_segments;
+    const uint16_t evicted_id = tier.first_id;
+    const uint32_t evicted_start = evict ? tier.starts.front() : 0;
+
+    if (evict) {
+        tier.first_id++;
+        tier.count--;
+        tier.starts.erase(tier.starts.begin());
+    }
+
+    const uint16_t id = tier.first_id + tier.count;
+
+    tier.count++;
+    tier.starts.push_back(timestamp);
+
+    if (!_write_manifest()) {
+        tier.count--;
+        tier.starts.pop_back();
+
+        if (evict) {
+            tier.first_id--;
+            tier.count++;
+            tier.starts.insert(tier.starts.begin(), evicted_start);
+        }
+
+        tier.broken = true;
+        return false;
+    }
+
+    if (evict) _backend->remove(_segment_key(index, evicted_id).c_str());
+
+    const uint32_t magic = TIME_SERIES_MAGIC;
+    const auto series_count = (uint8_t) _series.size();
+
+    const StorageChunk chunks[] = {
+        {&magic, sizeof(magic)},
+        {&index, sizeof(index)},
+        {&series_count, sizeof(series_count)},
+        {&timestamp, sizeof(timestamp)},
+    };
+
+    const String key = _segment_key(index, id);
+    const size_t written = _backend->write(key.c_str(), chunks, std::size(chunks));
+
+    tier.segment_size = written;
+    tier.block_size = 0;
+
+    tier.last = {};
+    tier.last.timestamp = timestamp;
+
+    tier.broken = written != TIME_SERIES_SEGMENT_HEADER_SIZE;
+    if (tier.broken) {
+        D_PRINTF("TimeSeriesStore(%s): Unable to create segment %s\r\n", _name, key.c_str());
+        return false;
+    }
+
+    VERBOSE(D_PRINTF("TimeSeriesStore(%s): Opened segment %s\r\n", _name, key.c_str()));
+    return true;
+}
+
+bool TimeSeriesStore::_flush_tier(uint8_t index) {
+    auto &tier = _tiers[index];
+    if (tier.block_size == 0) return true;
+
+    const auto size = (uint16_t) tier.block_size;
+    const uint32_t crc = crc32_calc(tier.block, size);
+
+    const StorageChunk chunks[] = {
+        {&size, sizeof(size)},
+        {&crc, sizeof(crc)},
+        {tier.block, size},
+    };
+
+    const String key = _segment_key(index, tier.first_id + tier.count - 1);
+    const size_t written = _backend->append(key.c_str(), chunks, std::size(chunks));
+
+    tier.segment_size += written;
+    tier.block_size = 0;
+
+    if (written != TIME_SERIES_BLOCK_HEADER_SIZE + size) {
+        // Rows are encoded over the segment state, so they can't be moved to a new segment
+        D_PRINTF("TimeSeriesStore(%s): Append to %s failed, %u bytes lost\r\n", _name, key.c_str(), size);
+
+        tier.broken = true;
+        return false;
+    }
+
+    return true;
+}
+
+void TimeSeriesStore::_schedule_flush() {
+    if (_flush_timer_id != TIMER_INVALID_ID) return;
+
+    _flush_timer_id = _timer.add_timeout([this](void *) {
+        _flush_timer_id = TIMER_INVALID_ID;
+        flush();
+    }, TIME_SERIES_FLUSH_INTERVAL);
+}
+
+bool TimeSeriesStore::_read_segment_header(uint8_t tier, uint16_t id, uint32_t &out_start) const {
+    uint8_t header[TIME_SERIES_SEGMENT_HEADER_SIZE];
+    if (_backend->read(_segment_key(tier, id).c_str(), 0, header, sizeof(header)) != sizeof(header)) return false;
+
+    uint32_t magic;
+    memcpy(&magic, header, sizeof(magic));
+    memcpy(&out_start, header + sizeof(magic) + 2 * sizeof(uint8_t), sizeof(out_start));
+
+    // Segments written with other set of series can't be decoded
+    return magic == TIME_SERIES_MAGIC && header[sizeof(magic)] == tier && header[sizeof(magic) + 1] == _series.size();
+}
+
+size_t TimeSeriesStore::_encode_row(uint8_t *ptr, const TimeSeriesRow &prev, uint32_t timestamp,
+                                    const int32_t *values, size_t count) {
+    size_t size = put_varint(ptr, zigzag_encode((int64_t) timestamp - prev.timestamp));
+    for (size_t i = 0; i < count; ++i) {
+        size += put_varint(ptr + size, zigzag_encode((int64_t) values[i] - prev.values[i]));
+    }
+
+    return size;
+}
+
+bool TimeSeriesStore::_decode_row(const uint8_t *ptr, size_t size, size_t &position, TimeSeriesRow &row, size_t count) {
+    TimeSeriesRow result = row;
+
+    uint64_t value;
+    if (!get_varint(ptr, size, position, value)) return false;
+    result.timestamp = (uint32_t) (result.timestamp + zigzag_decode(value));
+
+    for (size_t i = 0; i < count; ++i) {
+        if (!get_varint(ptr, size, position, value)) return false;
+        result.values[i] = (int32_t) (result.values[i] + zigzag_decode(value));
+    }
+
+    row = result;
+    return true;
+}
@@ -0,0 +1,282 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "./inline_function.h"
+#include "./storage_fs_backend.h"
+#include "./timer.h"
+#include "../base/parameter.h"
+
+#ifndef TIME_SERIES_MAX_SERIES
+#define TIME_SERIES_MAX_SERIES                  (8u)
+#endif
+#ifndef TIME_SERIES_MAX_TIERS
+#define TIME_SERIES_MAX_TIERS                   (4u)                    // Including raw tier
+#endif
+#ifndef TIME_SERIES_INTERVAL
+#define TIME_SERIES_INTERVAL                    (60000u)                // Sampling interval of the raw tier, ms
+#endif
+#ifndef TIME_SERIES_SEGMENT_SIZE
+#define TIME_SERIES_SEGMENT_SIZE                (4096u)                 // New segment is started when current one exceeds this size
+#endif
+#ifndef TIME_SERIES_MAX_SEGMENTS
+#define TIME_SERIES_MAX_SEGMENTS                (8u)                    // Per tier, the oldest segment is removed when exceeded
+#endif
+#ifndef TIME_SERIES_BLOCK_SIZE
+#define TIME_SERIES_BLOCK_SIZE                  (256u)                  // Rows are appended by blocks, also size of the query buffer
+#endif
+#ifndef TIME_SERIES_FLUSH_INTERVAL
+#define TIME_SERIES_FLUSH_INTERVAL              (600000u)               // Max age of the rows kept in RAM
+#endif
+
+constexpr uint32_t TIME_SERIES_MAGIC = 0x54535331;
+
+// Segment: [magic] [tier] [series count] [start timestamp] { [block size] [crc] [rows...] } * N
+constexpr size_t TIME_SERIES_SEGMENT_HEADER_SIZE = sizeof(uint32_t) + sizeof(uint8_t) + sizeof(uint8_t) + sizeof(uint32_t);
+constexpr size_t TIME_SERIES_BLOCK_HEADER_SIZE = sizeof(uint16_t) + sizeof(uint32_t);
+
+// Row: [timestamp delta] { [value delta] } * series count, every delta is zigzag varint of 64-bit difference
+constexpr size_t TIME_SERIES_ROW_MAX_SIZE = 10 * (1 + TIME_SERIES_MAX_SERIES);
+
+static_assert(TIME_SERIES_MAX_TIERS >= 1, "Unsupported TIME_SERIES_MAX_TIERS value");
+static_assert(TIME_SERIES_BLOCK_SIZE >= TIME_SERIES_BLOCK_HEADER_SIZE + TIME_SERIES_ROW_MAX_SIZE
+              && TIME_SERIES_BLOCK_SIZE <= UINT16_MAX, "Unsupported TIME_SERIES_BLOCK_SIZE value");
+static_assert(TIME_SERIES_SEGMENT_SIZE >= TIME_SERIES_SEGMENT_HEADER_SIZE + TIME_SERIES_BLOCK_SIZE,
+              "TIME_SERIES_SEGMENT_SIZE must fit at least one block");
+
+// Returns UNIX time in seconds or 0 if time isn't known yet
+typedef InlineFunction<uint32_t(), TIMER_FN_CAPACITY> TimeSeriesClockFn;
+
+struct TimeSeries {
+    const AbstractParameter *parameter;
+    float scale;
+    int32_t (*read)(const void *value, float scale);
+};
+
+// Decoder state of the row stream
+struct TimeSeriesRow {
+    uint32_t timestamp = 0;
+    int32_t values[TIME_SERIES_MAX_SERIES] = {};
+};
+
+struct TimeSeriesTier {
+    uint32_t resolution;                // Seconds, 0 for the raw tier
+    uint16_t max_segments;
+
+    // Segments are numbered sequentially, so only range is stored
+    uint16_t first_id = 0;
+    uint16_t count = 0;
+    std::vector<uint32_t> starts{};     // Start timestamp of every segment
+
+    uint32_t segment_size = 0;
+    bool broken = false;                // Current segment can't be extended
+
+    TimeSeriesRow last{};               // Last encoded row, including pending ones
+    uint8_t block[TIME_SERIES_BLOCK_SIZE]{};
+    size_t block_size = 0;
+
+    // Accumulator of the current bucket for downsampled tiers
+    uint32_t bucket = 0;
+    uint32_t samples = 0;
+    int64_t sums[TIME_SERIES_MAX_SERIES] = {};
+
+    TimeSeriesTier(uint32_t resolution, uint16_t max_segments) : resolution(resolution), max_segments(max_segments) {}
+};
+
+class TimeSeriesStore;
+
+/**
+ * Streams rows of a tier: only one block is kept in RAM.
+ */
+class TimeSeriesCursor {
+    const TimeSeriesStore &_store;
+    const TimeSeriesTier &_tier;
+    uint8_t _index;
+
+    uint32_t _from;
+    uint32_t _to;
+
+    bool _opened = false;
+    size_t _segment = 0;
+    uint32_t _position = 0;
+    uint32_t _segment_size = 0;
+    bool _pending = false;              // Decoding rows which aren't written yet
+
+    uint8_t _block[TIME_SERIES_BLOCK_SIZE];
+    size_t _block_size = 0;
+    size_t _block_position = 0;
+
+    TimeSeriesRow _row{};
+
+public:
+    TimeSeriesCursor(const TimeSeriesStore &store, uint8_t tier, uint32_t from, uint32_t to);
+
+    // Returns false when there are no more rows in the range
+    bool next(uint32_t &out_timestamp, int32_t *out_values);
+
+private:
+    bool _open_segment();
+    bool _read_block();
+};
+
+/**
+ * Append-only history of parameter values.
+ *
+ * Values of all series are sampled together every interval and stored as rows of scaled integers
+ * compressed with delta encoding and zigzag varints, so a slowly changing value takes 1 byte per sample.
+ * Rows are collected in RAM and appended by blocks with checksum, interrupted append loses only the last block.
+ *
+ * Besides the raw tier, every downsampled tier stores averages over its resolution (RRD-style),
+ * so old data is still available with lower precision after raw segments are removed.
+ * Each tier keeps at most max_segments segments, so disk usage is bounded.
+ *
+ * Timestamps are UNIX seconds from the clock, samples are skipped until the clock is set
+ * and samples older than the last one are ignored.
+ * Partially accumulated buckets of downsampled tiers are lost on restart.
+ */
+class TimeSeriesStore {
+    friend class TimeSeriesCursor;
+
+    Timer &_timer;
+    const char *_name;
+    unsigned long _interval;
+
+    StorageBackend *_backend = nullptr;
+    std::unique_ptr<StorageFsBackend> _fs_backend;
+
+    std::vector<TimeSeries> _series;
+    std::vector<TimeSeriesTier> _tiers;
+
+    TimeSeriesClockFn _clock = nullptr;
+
+    TimerId _sample_timer_id = TIMER_INVALID_ID;
+    TimerId _flush_timer_id = TIMER_INVALID_ID;
+
+public:
+    TimeSeriesStore(Timer &timer, const char *name, unsigned long interval = TIME_SERIES_INTERVAL,
+                    uint16_t max_segments = TIME_SERIES_MAX_SEGMENTS);
+    ~TimeSeriesStore();
+
+    TimeSeriesStore(const TimeSeriesStore &) = delete;
+    TimeSeriesStore &operator=(const TimeSeriesStore &) = delete;
+
+    /**
+     * Register series before begin(). Value is stored as round(value * scale),
+     * so scale defines precision of floating point values.
+     */
+    template<typename T, typename = std::enable_if_t<std::is_integral_v<T> || std::is_floating_point_v<T>>>
+    bool add_series(const AbstractParameter *parameter, float scale = 1);
+
+    // Register downsampled tier before begin(), resolution in seconds must grow with every tier
+    bool add_tier(uint32_t resolution, uint16_t max_segments = TIME_SERIES_MAX_SEGMENTS);
+
+    void set_clock(TimeSeriesClockFn clock) { _clock = std::move(clock); }
+
+    // Files under STORAGE_PATH of the filesystem
+    bool begin(FS *fs);
+
+    // Backend isn't owned by the store and must support appends
+    bool begin(StorageBackend *backend);
+
+    // Record current values, called automatically every interval
+    void sample();
+    void sample(uint32_t timestamp);
+
+    // Write rows kept in RAM
+    bool flush();
+
+    /**
+     * Call fn(uint32_t timestamp, const float *values, size_t count) for every row in [from, to].
+     * Tier is picked automatically: the finest one which still has data for from.
+     * Returns number of rows.
+     */
+    template<typename Fn>
+    size_t query(uint32_t from, uint32_t to, Fn fn) const;
+
+    template<typename Fn>
+    size_t query(uint8_t tier, uint32_t from, uint32_t to, Fn fn) const;
+
+    [[nodiscard]] inline size_t series_count() const { return _series.size(); }
+    [[nodiscard]] inline size_t tier_count() const { return _tiers.size(); }
+    [[nodiscard]] inline uint32_t tier_resolution(uint8_t tier) const { return _tiers[tier].resolution; }
+
+    // Oldest available timestamp of the tier, 0 if tier is empty
+    [[nodiscard]] uint32_t oldest(uint8_t tier) const;
+
+    // Finest tier which has data for the timestamp
+    [[nodiscard]] uint8_t pick_tier(uint32_t from) const;
+
+private:
+    [[nodiscard]] inline String _segment_key(uint8_t tier, uint16_t id) const {
+        return String(_name) + "." + String(tier) + "." + String(id);
+    }
+
+    bool _load_manifest();
+    bool _write_manifest();
+    void _load_tier(uint8_t tier);
+
+    void _append(uint8_t tier, uint32_t timestamp, const int32_t *values);
+    void _accumulate(uint8_t tier, uint32_t timestamp, const int32_t *values);
+
+    bool _open_segment(uint8_t tier, uint32_t timestamp);
+    bool _flush_tier(uint8_t tier);
+    void _schedule_flush();
+
+    [[nodiscard]] bool _read_segment_header(uint8_t tier, uint16_t id, uint32_t &out_start) const;
+
+    template<typename T>
+    static int32_t _read_value(const void *value, float scale);
+
+    static size_t _encode_row(uint8_t *ptr, const TimeSeriesRow &prev, uint32_t timestamp, const int32_t *values, size_t count);
+
+    // Row is decoded over the previous one. Returns false if row is truncated
+    static bool _decode_row(const uint8_t *ptr, size_t size, size_t &position, TimeSeriesRow &row, size_t count);
+};
+
+template<typename T, typename S1>
+bool TimeSeriesStore::add_series(const AbstractParameter *parameter, float scale) {
+    if (_backend || _series.size() >= TIME_SERIES_MAX_SERIES || parameter->size() != sizeof(T)) return false;
+
+    _series.push_back({parameter, scale, &_read_value<T>});
+    return true;
+}
+
+template<typename T>
+int32_t TimeSeriesStore::_read_value(const void *value, float scale) {
+    T result;
+    memcpy(&result, value, sizeof(T)); //To avoid unaligned memory access
+
+    return (int32_t) std::lround((double) result * scale);
+}
+
+template<typename Fn>
+size_t TimeSeriesStore::query(uint32_t from, uint32_t to, Fn fn) const {
+    return query(pick_tier(from), from, to, fn);
+}
+
+template<typename Fn>
+size_t TimeSeriesStore::query(uint8_t tier, uint32_t from, uint32_t to, Fn fn) const {
+    if (!_backend || tier >= _tiers.size()) return 0;
+
+    TimeSeriesCursor cursor(*this, tier, from, to);
+
+    uint32_t timestamp;
+    int32_t values[TIME_SERIES_MAX_SERIES];
+    float result[TIME_SERIES_MAX_SERIES];
+
+    size_t count = 0;
+    while (cursor.next(timestamp, values)) {
+        for (size_t i = 0; i < _series.size(); ++i) result[i] = (float) values[i] / _series[i].scale;
+
+        fn(timestamp, (const float *) result, _series.size());
+        count++;
+    }
+
+    return count;
+}
@@ -1,117 +1,671 @@
 #include "Arduino.h"
 
+#include <algorithm>
+
 #include "./timer.h"
 #include "../debug.h"
 
+Timer::Timer() {
+    std::fill(_buckets, _buckets + TIMER_WHEEL_BUCKETS + 1, TIMER_NIL);
+}
+
 Timer::~Timer() {
-    if (_entries == nullptr) return;
+    if (_blocks == nullptr) return;
 
-    delete[] _entries;
-    _entries = nullptr;
+    for (unsigned long i = 0; i < _count / TIMER_GROW_AMOUNT; ++i) {
+        delete[] _blocks[i];
+    }
+
+    delete[] _blocks;
+    _blocks = nullptr;
 
     _count = 0;
     _free_count = 0;
 }
 
-unsigned long Timer::add_timeout(const TimerFn &callback, unsigned long interval, void *parameter) {
-    return _add(callback, interval, false, parameter);
+TimerId Timer::add_timeout(TimerFn callback, unsigned long interval, void *parameter) {
+    return _add(std::move(callback), interval, false, parameter);
 }
 
-void Timer::clear_timeout(unsigned long timer_id) {
+void Timer::clear_timeout(TimerId timer_id) {
+    // Posted timeout becomes active only when the inbox is drained
+    _process_inbox();
     _clear(timer_id);
 }
 
-unsigned long Timer::add_interval(const TimerFn &callback, unsigned long interval, void *parameter) {
-    return _add(callback, interval, true, parameter);
+TimerId Timer::add_interval(TimerFn callback, unsigned long interval, void *parameter, TimerCatchUp catch_up) {
+    return _add(std::move(callback), interval, true, parameter, catch_up);
 }
 
-void Timer::clear_interval(unsigned long timer_id) {
+void Timer::clear_interval(TimerId timer_id) {
+    _process_inbox();
     _clear(timer_id);
 }
 
 void Timer::handle_timers() {
-    if (_entries == nullptr || _count == _free_count) return;
+#if TIMER_INBOX_SIZE > 0
+    // Entries are allocated on the loop, so constructor doesn't allocate anything
+    if (!_reserve_ready) {
+        _reserve_ready = true;
+        _fill_reserve(TIMER_INBOX_SIZE < 32 ? (1u << TIMER_INBOX_SIZE) - 1 : ~0u);
+    }
+#endif
 
-    for (unsigned long i = 0; i < _count; ++i) {
-        auto &entry = _entries[i];
+    _process_inbox();
 
-        const auto now = millis();
-        if (!entry.active || (now - entry.created_at) < entry.interval) continue;
+    if (_blocks == nullptr || _active_count() == 0) return;
 
-        if (entry.repeat) {
-            entry.created_at = now;
-        } else {
-            // To avoid repeating run if handle_timers() was called from callback
-            entry.interval = ~0ul;
+    const auto now = millis();
+    while (true) {
+        while (_buckets[TIMER_EXPIRED_BUCKET] != TIMER_NIL) {
+            _fire(_buckets[TIMER_EXPIRED_BUCKET], now);
+        }
+
+        if ((long) (now - _current) < 0) break;
+        _advance(now);
+    }
+}
+
+#if TIMER_INBOX_SIZE > 0
+TimerId Timer::post_timeout(TimerFn callback, unsigned long interval, void *parameter) {
+    uint32_t mask = _reserved_mask.load(std::memory_order_acquire);
+    uint8_t slot;
+    do {
+        if (mask == 0) return TIMER_INVALID_ID;
+        slot = __builtin_ctz(mask);
+    } while (!_reserved_mask.compare_exchange_weak(mask, mask & ~(1u << slot), std::memory_order_acquire));
+
+    const TimerId id = _reserved[slot];
+    const bool success = _inbox.push(TimerRequest{
+        .clear_id = TIMER_INVALID_ID,
+        .id = id,
+        .reserve_slot = slot,
+        .callback = std::move(callback),
+        .parameter = parameter,
+        .interval = interval,
+        .posted_at = millis(),
+    });
+
+    if (!success) {
+        // Slot isn't refilled until its request is drained, so reserved id is still there
+        _reserved_mask.fetch_or(1u << slot, std::memory_order_release);
+        return TIMER_INVALID_ID;
+    }
+
+    if (_wakeup_callback) _wakeup_callback();
+    return id;
+}
+
+bool Timer::post_clear(TimerId timer_id) {
+    const bool success = _inbox.push(TimerRequest{.clear_id = timer_id});
+
+    if (success && _wakeup_callback) _wakeup_callback();
+    return success;
+}
+#endif
+
+void Timer::_process_inbox() {
+#if TIMER_INBOX_SIZE > 0
+    uint32_t drained = 0;
+
+    TimerRequest request;
+    while (_inbox.pop(request)) {
+        if (request.clear_id != TIMER_INVALID_ID) {
+            _clear(request.clear_id);
+            continue;
+        }
+
+        const unsigned long elapsed = millis() - request.posted_at;
+        const auto interval = request.interval > elapsed ? request.interval - elapsed : 0;
+
+        const uint32_t slot_bit = 1u << request.reserve_slot;
+
+        _reserved_count--;
+        drained |= slot_bit;
+
+        if (_cancelled_mask & slot_bit) {
+            _cancelled_mask &= ~slot_bit;
+            _release(request.id & 0xffff);
+            continue;
         }
 
-        VERBOSE(D_PRINTF("Call timer: %lu\r\n", i));
-        entry.callback(entry.parameter);
+        _activate(request.id & 0xffff, std::move(request.callback), interval, false, request.parameter, TimerCatchUp::COALESCE);
+    }
+
+    if (drained) _fill_reserve(drained);
+#endif
+}
+
+#if TIMER_INBOX_SIZE > 0
+void Timer::_fill_reserve(uint32_t slots) {
+    while (slots) {
+        const auto slot = __builtin_ctz(slots);
+        slots &= slots - 1;
 
-        if (!entry.repeat) {
-            _clear(i);
+        const auto index = _take_free();
+        if (index == TIMER_NIL) {
+            D_PRINT("Timer: Unable to reserve entry for the inbox");
+            return;
         }
+
+        _reserved_count++;
+        _reserved[slot] = _make_id(index, _entry(index).generation);
+        _cancelled_mask &= ~(1u << slot);
+
+        // Release order makes the id visible before the slot becomes available
+        _reserved_mask.fetch_or(1u << slot, std::memory_order_release);
     }
 }
 
-unsigned long Timer::_add(const TimerFn &callback, unsigned long interval, bool repeat, void *parameter) {
-    if (_free_count == 0) _grow();
+bool Timer::_cancel_reserved(TimerId timer_id) {
+    if (!_reserve_ready) return false;
 
-    for (unsigned long i = 0; i < _count; ++i) {
-        auto &entry = _entries[i];
-        if (entry.active) continue;
+    const uint32_t available = _reserved_mask.load(std::memory_order_acquire);
+    for (uint8_t slot = 0; slot < TIMER_INBOX_SIZE; ++slot) {
+        const uint32_t slot_bit = 1u << slot;
+        if (_reserved[slot] != timer_id || (available & slot_bit)) continue;
 
-        entry.active = true;
-        entry.created_at = millis();
-        entry.interval = interval;
-        entry.repeat = repeat;
-        entry.callback = callback;
-        entry.parameter = parameter;
+        // Id is taken by post_timeout(), but its request isn't published yet
+        _cancelled_mask |= slot_bit;
+        return true;
+    }
+
+    return false;
+}
+#endif
 
-        _free_count--;
+bool Timer::next_deadline(unsigned long &out_deadline) const {
+    if (_blocks == nullptr || _active_count() == 0) return false;
 
-        VERBOSE(D_PRINTF("Add %s: %lu. Used: %lu / %lu\r\n", repeat ? "interval" : "timeout", i, _count - _free_count, _count));
+    if (_bucket_deadline(TIMER_EXPIRED_BUCKET, out_deadline)) return true;
 
-        return i;
+    bool found = false;
+    for (uint8_t level = 0; level < TIMER_WHEEL_LEVELS; ++level) {
+        const uint64_t occupied = _occupied[level];
+        if (!occupied) continue;
+
+        // Current slot is the nearest one until it's cascaded, after that it holds the farthest timers
+        const auto current_slot = (_current >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+        const bool cascaded = (_current & ((1ul << (TIMER_WHEEL_BITS * level)) - 1)) != 0;
+        const auto start = (current_slot + (cascaded ? 1 : 0)) & TIMER_WHEEL_MASK;
+
+        const uint64_t rotated = start ? (occupied >> start) | (occupied << (TIMER_WHEEL_SLOTS - start)) : occupied;
+        const auto slot = (start + __builtin_ctzll(rotated)) & TIMER_WHEEL_MASK;
+
+        unsigned long deadline;
+        if (!_bucket_deadline(level * TIMER_WHEEL_SLOTS + slot, deadline)) continue;
+
+        if (!found || (long) (deadline - out_deadline) < 0) out_deadline = deadline;
+        found = true;
+    }
+
+    return found;
+}
+
+bool Timer::_bucket_deadline(uint16_t bucket, unsigned long &out_deadline) const {
+    auto index = _buckets[bucket];
+    if (index == TIMER_NIL) return false;
+
+    out_deadline = _entry(index).expires;
+    for (index = _entry(index).next; index != TIMER_NIL; index = _entry(index).next) {
+        const auto deadline = _entry(index).expires;
+        if ((long) (deadline - out_deadline) < 0) out_deadline = deadline;
     }
 
-    D_PRINT("Timer: Failed to add timer. No free slots!");
-    return -1ul;
+    return true;
 }
 
-void Timer::_clear(unsigned long timer_id) {
-    if (_entries == nullptr) return;
+uint16_t Timer::_take_free() {
+    if (_free_head == TIMER_NIL) _grow();
+    if (_free_head == TIMER_NIL) return TIMER_NIL;
+
+    const auto index = _free_head;
+    auto &entry = _entry(index);
+
+    _free_head = entry.next;
+    entry.next = TIMER_NIL;
+    _free_count--;
+
+    return index;
+}
+
+TimerId Timer::_add(TimerFn callback, unsigned long interval, bool repeat, void *parameter, TimerCatchUp catch_up) {
+    const auto index = _take_free();
+    if (index == TIMER_NIL) {
+        D_PRINT("Timer: Failed to add timer. No free slots!");
+        return TIMER_INVALID_ID;
+    }
+
+    return _activate(index, std::move(callback), interval, repeat, parameter, catch_up);
+}
+
+TimerId Timer::_activate(uint16_t index, TimerFn callback, unsigned long interval, bool repeat, void *parameter,
+                         TimerCatchUp catch_up) {
+    // Wheel is empty except this entry, so it's safe to move its clock
+    if (_active_count() == 1) _current = millis();
+
+    auto &entry = _entry(index);
+
+    entry.active = true;
+    entry.deadline = millis() + interval;
+    entry.interval = interval;
+    entry.repeat = repeat;
+    entry.catch_up = catch_up;
+    entry.callback = std::move(callback);
+    entry.parameter = parameter;
+
+    _schedule(index);
+
+    VERBOSE(D_PRINTF("Add %s: %u. Used: %lu / %lu\r\n", repeat ? "interval" : "timeout", index, _active_count(), _count));
+
+    return _make_id(index, entry.generation);
+}
+
+void Timer::_clear(TimerId timer_id) {
+    auto *entry = _find(timer_id);
+    if (entry == nullptr) {
+#if TIMER_INBOX_SIZE > 0
+        // Posted timeout is dropped when its request is drained
+        if (_cancel_reserved(timer_id)) return;
+#endif
+
+        VERBOSE(D_PRINTF("Timer: Ignore clear of stale timer %08X\r\n", timer_id));
+        return;
+    }
+
+    const uint16_t index = timer_id & 0xffff;
+
+    entry->active = false;
+    _unlink(index);
+
+    // Callback can't be destroyed while executing, it will be released after the call
+    if (!entry->running) _release(index);
+}
+
+TimerEntry *Timer::_find(TimerId timer_id) const {
+    const uint16_t index = timer_id & 0xffff;
+    if (_blocks == nullptr || index >= _count) return nullptr;
+
+    auto &entry = _entry(index);
+    if (!entry.active || entry.generation != (timer_id >> 16)) return nullptr;
+
+    return &entry;
+}
+
+void Timer::set_slack(TimerId timer_id, unsigned long slack) {
+    auto *entry = _find(timer_id);
+    if (entry == nullptr) return;
+
+    entry->slack = slack;
+
+    // Re-schedule only timers waiting in the wheel
+    if (entry->bucket < TIMER_WHEEL_BUCKETS) {
+        const uint16_t index = timer_id & 0xffff;
+
+        _unlink(index);
+        _schedule(index);
+    }
+}
+
+#ifdef TIMER_LATENESS_STATS
+const TimerLatenessHistogram *Timer::lateness(TimerId timer_id) const {
+    auto *entry = _find(timer_id);
+    return entry ? &entry->lateness : nullptr;
+}
+
+void Timer::reset_lateness(TimerId timer_id) {
+    auto *entry = _find(timer_id);
+    if (entry) entry->lateness = {};
+}
+#endif
+
+#ifdef TIMER_PROFILING
+void Timer::set_name(TimerId timer_id, const char *name) {
+    auto *entry = _find(timer_id);
+    if (entry) entry->profile.name = name;
+}
+
+void Timer::set_slow_callback_hook(unsigned long threshold_us, TimerSlowCallbackFn callback) {
+    _slow_threshold_us = threshold_us;
+    _slow_callback = std::move(callback);
+}
+
+bool Timer::profile(TimerId timer_id, TimerProfile &out_profile) const {
+    auto *entry = _find(timer_id);
+    if (entry == nullptr) return false;
+
+    out_profile = entry->profile;
+    out_profile.id = timer_id;
+
+    return true;
+}
+
+size_t Timer::profile_snapshot(TimerProfile *out_profiles, size_t max_count) const {
+    size_t copied = 0;
+    for (unsigned long i = 0; i < _count && copied < max_count; ++i) {
+        const auto &entry = _entry(i);
+        if (!entry.active) continue;
+
+        out_profiles[copied] = entry.profile;
+        out_profiles[copied].id = _make_id(i, entry.generation);
+        ++copied;
+    }
+
+    return copied;
+}
+
+void Timer::reset_profiles() {
+    for (unsigned long i = 0; i < _count; ++i) {
+        auto &profile = _entry(i).profile;
+
+        profile.calls = 0;
+        profile.total_us = 0;
+        profile.max_us = 0;
+        profile.last_run = 0;
+    }
+}
+#endif
 
-    auto &entry = _entries[timer_id];
-    if (!entry.active) return;
+void Timer::_release(uint16_t index) {
+    auto &entry = _entry(index);
+    const uint16_t generation = entry.generation + 1;
 
     entry = TimerEntry();
+    entry.generation = generation;
+    entry.next = _free_head;
+
+    _free_head = index;
     _free_count++;
 
-    VERBOSE(D_PRINTF("Remove timer: %lu. Used: %lu / %lu\r\n", timer_id, _count - _free_count, _count));
+    VERBOSE(D_PRINTF("Remove timer: %u. Used: %lu / %lu\r\n", index, _active_count(), _count));
+}
+
+void Timer::_schedule(uint16_t index) {
+    auto &entry = _entry(index);
+    entry.expires = _apply_slack(entry.deadline, entry.slack);
+
+    _link_wheel(index);
+}
+
+void Timer::_link_wheel(uint16_t index) {
+    auto &entry = _entry(index);
+    const unsigned long delta = entry.expires - _current;
+
+    uint16_t bucket;
+    if ((long) delta < 0) {
+        // Already expired, process on the nearest tick
+        bucket = _current & TIMER_WHEEL_MASK;
+    } else {
+        unsigned long expires = entry.expires;
+        if ((delta >> (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) != 0) {
+            // Too far: park at the farthest slot, it will be re-scheduled on cascade
+            expires = _current + (1ul << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1;
+        }
+
+        uint8_t level = 0;
+        while (level < TIMER_WHEEL_LEVELS - 1 && ((expires - _current) >> (TIMER_WHEEL_BITS * (level + 1))) != 0) {
+            ++level;
+        }
+
+        bucket = level * TIMER_WHEEL_SLOTS + ((expires >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK);
+    }
+
+    _link(index, bucket);
+}
+
+unsigned long Timer::_apply_slack(unsigned long deadline, unsigned long slack) const {
+    if (slack == 0) return deadline;
+
+    // Join the earliest timer already scheduled within the window
+    const unsigned long limit = deadline + slack;
+
+    unsigned long expires;
+    if (_find_expiry(deadline, limit, expires)) return expires;
+
+    // Otherwise round to the coarsest power of two boundary within the window,
+    // so timers with overlapping windows added later can end up on the same tick
+    const unsigned long diff = deadline ^ limit;
+    if (diff == 0) return deadline;
+
+    const auto bit = sizeof(diff) * 8 - 1 - __builtin_clzl(diff);
+    return limit & ~((1ul << bit) - 1);
+}
+
+bool Timer::_find_expiry(unsigned long from, unsigned long to, unsigned long &out_expires) const {
+    bool found = false;
+
+    for (uint8_t level = 0; level < TIMER_WHEEL_LEVELS; ++level) {
+        const uint8_t shift = TIMER_WHEEL_BITS * level;
+
+        // Timer at this level is stored in the slot of its expiry, so only slots covering the window are checked
+        const unsigned long first = from >> shift;
+        const unsigned long count = (to >> shift) - first + 1;
+        const bool wide = count >= TIMER_WHEEL_SLOTS;
+
+        uint64_t slots = ~0ull;
+        if (!wide) slots = (1ull << count) - 1;
+
+        // Slots are ordered by expiry starting from the window start, so the first match is the earliest one
+        const auto start = first & TIMER_WHEEL_MASK;
+        const uint64_t occupied = _occupied[level];
+        uint64_t rotated = (start ? (occupied >> start) | (occupied << (TIMER_WHEEL_SLOTS - start)) : occupied) & slots;
+
+        while (rotated) {
+            const auto slot = (start + __builtin_ctzll(rotated)) & TIMER_WHEEL_MASK;
+            rotated &= rotated - 1;
+
+            bool matched = false;
+            for (auto index = _buckets[level * TIMER_WHEEL_SLOTS + slot]; index != TIMER_NIL; index = _entry(index).next) {
+                const auto expires = _entry(index).expires;
+                if ((long) (expires - from) < 0 || (long) (to - expires) < 0) continue;
+
+                if (!found || (long) (expires - out_expires) < 0) out_expires = expires;
+                found = matched = true;
+            }
+
+            // Window covers the whole level, so only its nearest bucket is worth checking
+            if (matched || wide) break;
+        }
+    }
+
+    return found;
+}
+
+void Timer::_link(uint16_t index, uint16_t bucket) {
+    auto &entry = _entry(index);
+    auto &head = _buckets[bucket];
+
+    entry.bucket = bucket;
+    entry.prev = TIMER_NIL;
+    entry.next = head;
+
+    if (head != TIMER_NIL) _entry(head).prev = index;
+    head = index;
+
+    if (bucket < TIMER_WHEEL_BUCKETS) {
+        _occupied[bucket / TIMER_WHEEL_SLOTS] |= 1ull << (bucket & TIMER_WHEEL_MASK);
+    }
+}
+
+void Timer::_unlink(uint16_t index) {
+    auto &entry = _entry(index);
+    if (entry.bucket == TIMER_NIL) return;
+
+    if (entry.prev != TIMER_NIL) {
+        _entry(entry.prev).next = entry.next;
+    } else {
+        _buckets[entry.bucket] = entry.next;
+    }
+
+    if (entry.next != TIMER_NIL) _entry(entry.next).prev = entry.prev;
+
+    if (entry.bucket < TIMER_WHEEL_BUCKETS && _buckets[entry.bucket] == TIMER_NIL) {
+        _occupied[entry.bucket / TIMER_WHEEL_SLOTS] &= ~(1ull << (entry.bucket & TIMER_WHEEL_MASK));
+    }
+
+    entry.bucket = TIMER_NIL;
+    entry.prev = TIMER_NIL;
+    entry.next = TIMER_NIL;
+}
+
+uint16_t Timer::_detach(uint16_t bucket) {
+    const auto head = _buckets[bucket];
+
+    _buckets[bucket] = TIMER_NIL;
+    _occupied[bucket / TIMER_WHEEL_SLOTS] &= ~(1ull << (bucket & TIMER_WHEEL_MASK));
+
+    return head;
+}
+
+void Timer::_cascade(uint8_t level) {
+    const auto slot = (_current >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+
+    auto index = _detach(level * TIMER_WHEEL_SLOTS + slot);
+    while (index != TIMER_NIL) {
+        const auto next = _entry(index).next;
+
+        // Expiry is kept, so timers grouped by slack stay together
+        _link_wheel(index);
+        index = next;
+    }
+
+    if (slot == 0 && level + 1u < TIMER_WHEEL_LEVELS) _cascade(level + 1);
+}
+
+void Timer::_advance(unsigned long now) {
+    const auto slot = _current & TIMER_WHEEL_MASK;
+    if (slot == 0 && TIMER_WHEEL_LEVELS > 1) _cascade(1);
+
+    auto index = _detach(slot);
+    while (index != TIMER_NIL) {
+        const auto next = _entry(index).next;
+        _link(index, TIMER_EXPIRED_BUCKET);
+        index = next;
+    }
+
+    // Jump to the next occupied slot, but not further than the next cascade
+    unsigned long next_tick = (_current | TIMER_WHEEL_MASK) + 1;
+    if (slot != TIMER_WHEEL_MASK) {
+        const uint64_t pending = _occupied[0] >> (slot + 1);
+        if (pending) next_tick = _current + 1 + __builtin_ctzll(pending);
+    }
+
+    if ((long) (next_tick - (now + 1)) > 0) next_tick = now + 1;
+    _current = next_tick;
+}
+
+void Timer::_fire(uint16_t index, unsigned long now) {
+    auto &entry = _entry(index);
+    _unlink(index);
+
+#ifdef TIMER_LATENESS_STATS
+    // Slack delay is allowed, so lateness is counted from the planned call time
+    const unsigned long late = millis() - entry.expires;
+    if ((long) late > 0) {
+        const auto bucket = std::min<unsigned>(TIMER_LATENESS_BUCKETS - 1, sizeof(late) * 8 - __builtin_clzl(late));
+        entry.lateness.buckets[bucket]++;
+        entry.lateness.max = std::max(entry.lateness.max, late);
+    } else {
+        entry.lateness.buckets[0]++;
+    }
+#endif
+
+    if (entry.repeat) {
+        _reschedule(entry, now);
+
+        // Missed periods go straight to the expired list to be called within the current pass
+        if (entry.catch_up == TimerCatchUp::BURST && entry.interval > 0 && (long) (now - entry.deadline) >= 0) {
+            entry.expires = entry.deadline;
+            _link(index, TIMER_EXPIRED_BUCKET);
+        } else {
+            _schedule(index);
+        }
+    }
+
+    VERBOSE(D_PRINTF("Call timer: %u\r\n", index));
+
+#ifdef TIMER_PROFILING
+    const auto started_at = micros();
+    entry.profile.last_run = millis();
+#endif
+
+    entry.running = true;
+    entry.callback(entry.parameter);
+    entry.running = false;
+
+#ifdef TIMER_PROFILING
+    const unsigned long duration = micros() - started_at;
+
+    auto &profile = entry.profile;
+    profile.calls++;
+    profile.total_us += duration;
+    profile.max_us = std::max(profile.max_us, duration);
+
+    if (_slow_callback && duration >= _slow_threshold_us) {
+        D_PRINTF("Timer: Slow callback %s (%u): %lu us\r\n", profile.name ? profile.name : "<unnamed>", index, duration);
+
+        profile.id = _make_id(index, entry.generation);
+        _slow_callback(profile, duration);
+    }
+#endif
+
+    if (!entry.active) {
+        _release(index);
+    } else if (!entry.repeat) {
+        entry.active = false;
+        _release(index);
+    }
+}
+
+void Timer::_reschedule(TimerEntry &entry, unsigned long now) {
+    if (entry.catch_up == TimerCatchUp::SKIP || entry.interval == 0) {
+        entry.deadline = now + entry.interval;
+        return;
+    }
+
+    // Schedule from the previous deadline, so lateness doesn't accumulate
+    entry.deadline += entry.interval;
+
+    const unsigned long late = now - entry.deadline;
+    if (entry.catch_up == TimerCatchUp::COALESCE && (long) late >= 0) {
+        entry.deadline += (late / entry.interval + 1) * entry.interval;
+    }
 }
 
 void Timer::_grow() {
     const unsigned long new_count = _count + TIMER_GROW_AMOUNT;
-    TimerEntry *new_data = nullptr;
+    if (new_count >= TIMER_NIL) {
+        D_PRINT("Timer: Unable to grow, too many timers");
+        return;
+    }
+
+    const unsigned long block_count = _count / TIMER_GROW_AMOUNT;
+
+    auto *new_blocks = new(std::nothrow) TimerEntry *[block_count + 1];
+    auto *new_block = new(std::nothrow) TimerEntry[TIMER_GROW_AMOUNT];
+    if (!new_blocks || !new_block) {
+        delete[] new_blocks;
+        delete[] new_block;
 
-    new_data = new(std::nothrow) TimerEntry[new_count];
-    if (!new_data) {
         D_PRINT("Timer: Unable to allocate memory");
         return;
     }
 
-    if (_entries != nullptr) {
-        for (unsigned long i = 0; i < _count; ++i) {
-            new_data[i] = std::move(_entries[i]);
-        }
+    if (_blocks != nullptr) {
+        std::copy(_blocks, _blocks + block_count, new_blocks);
+        delete[] _blocks;
+    }
+
+    new_blocks[block_count] = new_block;
 
-        delete[] _entries;
+    for (unsigned long i = TIMER_GROW_AMOUNT; i > 0; --i) {
+        new_block[i - 1].next = _free_head;
+        _free_head = _count + i - 1;
     }
 
     D_PRINTF("Grow timer memory from %lu to %lu\r\n", _count, new_count);
 
-    _entries = new_data;
+    _blocks = new_blocks;
     _count = new_count;
     _free_count += TIMER_GROW_AMOUNT;
 }
@@ -1,39 +1,289 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+
 #ifndef TIMER_GROW_AMOUNT
 #define TIMER_GROW_AMOUNT                       (8u)
 #endif
 
-#include "functional"
+#ifndef TIMER_WHEEL_LEVELS
+#define TIMER_WHEEL_LEVELS                      (4u)                    // Each level covers 64x longer range than previous
+#endif
+
+#ifndef TIMER_FN_CAPACITY
+#define TIMER_FN_CAPACITY                       (16u)                   // Max size of callback captures
+#endif
+
+#ifndef TIMER_LATENESS_BUCKETS
+#define TIMER_LATENESS_BUCKETS                  (8u)                    // Used only if TIMER_LATENESS_STATS defined
+#endif
+
+#ifndef TIMER_INBOX_SIZE
+#define TIMER_INBOX_SIZE                        (8u)                    // Max pending requests posted from other tasks or ISR, 0 to disable
+#endif
+
+#include "./inline_function.h"
+#include "./mpsc_queue.h"
+#include "../utils/enum.h"
+
+typedef InlineFunction<void(void *), TIMER_FN_CAPACITY> TimerFn;
+
+// Upper 16 bits hold slot generation, lower 16 bits hold slot index
+typedef uint32_t TimerId;
+constexpr TimerId TIMER_INVALID_ID = ~(TimerId) 0;
+
+constexpr uint8_t TIMER_WHEEL_BITS = 6;
+constexpr uint16_t TIMER_WHEEL_SLOTS = 1u << TIMER_WHEEL_BITS;
+constexpr uint16_t TIMER_WHEEL_MASK = TIMER_WHEEL_SLOTS - 1;
+
+// Last bucket isn't a part of the wheel: it holds expired timers waiting for the call
+constexpr uint16_t TIMER_WHEEL_BUCKETS = TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS;
+constexpr uint16_t TIMER_EXPIRED_BUCKET = TIMER_WHEEL_BUCKETS;
+
+constexpr uint16_t TIMER_NIL = 0xffff;
+
+/**
+ * How interval handles missed periods when it was called late:
+ * COALESCE - all missed periods are merged into a single call, schedule stays phase-locked
+ * BURST - every missed period gets its own call, schedule stays phase-locked
+ * SKIP - next period starts from the actual call time, so schedule drifts by lateness
+ */
+MAKE_ENUM_AUTO(TimerCatchUp, uint8_t,
+    COALESCE,
+    BURST,
+    SKIP,
+)
+
+/**
+ * Bucket 0 counts calls made on time, bucket N counts calls late for [2^(N-1), 2^N) ms,
+ * the last bucket counts anything later.
+ */
+struct TimerLatenessHistogram {
+    uint32_t buckets[TIMER_LATENESS_BUCKETS] = {};
+    unsigned long max = 0;
+};
 
-typedef std::function<void(void *)> TimerFn;
+struct TimerProfile {
+    TimerId id = TIMER_INVALID_ID;
+    const char *name = nullptr;
+
+    uint32_t calls = 0;
+    uint64_t total_us = 0;
+    unsigned long max_us = 0;
+    unsigned long last_run = 0;             // millis() of the last call start
+};
+
+typedef InlineFunction<void(), TIMER_FN_CAPACITY> TimerWakeupFn;
+
+// Request posted to the Timer from another task or ISR
+struct TimerRequest {
+    TimerId clear_id = TIMER_INVALID_ID;    // Clear request if valid, otherwise add request
+    TimerId id = TIMER_INVALID_ID;          // Reserved entry of the add request
+    uint8_t reserve_slot = 0;
+
+    TimerFn callback = nullptr;
+    void *parameter = nullptr;
+    unsigned long interval = 0;
+    unsigned long posted_at = 0;
+};
+
+typedef InlineFunction<void(const TimerProfile &profile, unsigned long duration_us), TIMER_FN_CAPACITY> TimerSlowCallbackFn;
+
+static_assert(TIMER_WHEEL_LEVELS >= 1 && TIMER_WHEEL_LEVELS * TIMER_WHEEL_BITS < 32, "Unsupported TIMER_WHEEL_LEVELS value");
 
 struct TimerEntry {
     bool active = false;
     bool repeat = false;
+    bool running = false;
+    TimerCatchUp catch_up = TimerCatchUp::COALESCE;
     TimerFn callback = nullptr;
     void *parameter = nullptr;
     unsigned long interval = 0;
-    unsigned long created_at = 0;
+    unsigned long deadline = 0;
+    unsigned long slack = 0;
+    unsigned long expires = 0;              // Actual call time, deadline adjusted by slack
+
+    uint16_t generation = 0;
+
+#ifdef TIMER_LATENESS_STATS
+    TimerLatenessHistogram lateness{};
+#endif
+
+#ifdef TIMER_PROFILING
+    TimerProfile profile{};
+#endif
+
+    // Free slots are chained through next
+    uint16_t bucket = TIMER_NIL;
+    uint16_t prev = TIMER_NIL;
+    uint16_t next = TIMER_NIL;
 };
 
+/**
+ * Hierarchical timing wheel with 1 ms resolution.
+ *
+ * Adding and removing a timer is O(1), handle_timers() touches only buckets of elapsed ticks
+ * and skips empty ones using occupancy bitmaps, so its cost depends on the amount of due timers
+ * rather than on the amount of registered ones.
+ *
+ * Timer entries are allocated in blocks of TIMER_GROW_AMOUNT and never move,
+ * so it's safe to add new timers from the callback.
+ * Free entries are kept in a free-list and every reuse bumps entry generation,
+ * so a stale TimerId can't affect unrelated timer which took the same slot.
+ */
 class Timer {
-    TimerEntry *_entries = nullptr;
+    TimerEntry **_blocks = nullptr;
     unsigned long _count = 0;
     unsigned long _free_count = 0;
+    uint16_t _free_head = TIMER_NIL;
+
+    uint16_t _buckets[TIMER_WHEEL_BUCKETS + 1];
+    uint64_t _occupied[TIMER_WHEEL_LEVELS] = {};
+
+    // Next tick to process, all previous ticks already processed
+    unsigned long _current = 0;
+
+#if TIMER_INBOX_SIZE > 0
+    static_assert(TIMER_INBOX_SIZE <= 32, "TIMER_INBOX_SIZE should be at most 32");
+
+    MpscQueue<TimerRequest, TIMER_INBOX_SIZE> _inbox;
+    TimerWakeupFn _wakeup_callback = nullptr;
+
+    // Entries are reserved by the loop, so post_timeout() returns the id without touching the entries
+    TimerId _reserved[TIMER_INBOX_SIZE];
+    std::atomic<uint32_t> _reserved_mask{0};    // Bit is set while reserved id is available for posting
+    uint32_t _cancelled_mask = 0;               // Posted id is cleared before its request is drained, loop only
+    unsigned long _reserved_count = 0;          // Entries taken from the free-list but not activated yet
+    bool _reserve_ready = false;                // Reserve is filled by the first handle_timers()
+#endif
+
+#ifdef TIMER_PROFILING
+    unsigned long _slow_threshold_us = 0;
+    TimerSlowCallbackFn _slow_callback = nullptr;
+#endif
 
     void _grow();
-    unsigned long _add(const TimerFn &callback, unsigned long interval, bool repeat, void *parameter = nullptr);
-    void _clear(unsigned long timer_id);
+    [[nodiscard]] uint16_t _take_free();
+    TimerId _add(TimerFn callback, unsigned long interval, bool repeat, void *parameter = nullptr,
+        TimerCatchUp catch_up = TimerCatchUp::COALESCE);
+    TimerId _activate(uint16_t index, TimerFn callback, unsigned long interval, bool repeat, void *parameter,
+        TimerCatchUp catch_up);
+    void _clear(TimerId timer_id);
+    void _release(uint16_t index);
+
+    void _schedule(uint16_t index);
+    void _link_wheel(uint16_t index);
+    void _link(uint16_t index, uint16_t bucket);
+    void _unlink(uint16_t index);
+    uint16_t _detach(uint16_t bucket);
+
+    void _cascade(uint8_t level);
+    void _advance(unsigned long now);
+    void _fire(uint16_t index, unsigned long now);
+    void _reschedule(TimerEntry &entry, unsigned long now);
+
+    [[nodiscard]] unsigned long _apply_slack(unsigned long deadline, unsigned long slack) const;
+    [[nodiscard]] bool _find_expiry(unsigned long from, unsigned long to, unsigned long &out_expires) const;
+
+    [[nodiscard]] TimerEntry *_find(TimerId timer_id) const;
+
+    void _process_inbox();
+    void _fill_reserve(uint32_t slots);
+    bool _cancel_reserved(TimerId timer_id);
+
+    [[nodiscard]] bool _bucket_deadline(uint16_t bucket, unsigned long &out_deadline) const;
+
+    [[nodiscard]] inline unsigned long _active_count() const {
+#if TIMER_INBOX_SIZE > 0
+        return _count - _free_count - _reserved_count;
+#else
+        return _count - _free_count;
+#endif
+    }
+
+    [[nodiscard]] inline TimerEntry &_entry(uint16_t index) const {
+        return _blocks[index / TIMER_GROW_AMOUNT][index % TIMER_GROW_AMOUNT];
+    }
+
+    [[nodiscard]] static inline TimerId _make_id(uint16_t index, uint16_t generation) {
+        return ((TimerId) generation << 16) | index;
+    }
 
 public:
+    Timer();
     ~Timer();
 
+    Timer(const Timer &) = delete;
+    Timer &operator=(const Timer &) = delete;
+
     void handle_timers();
 
-    unsigned long add_timeout(const TimerFn &callback, unsigned long interval, void *parameter = nullptr);
-    void clear_timeout(unsigned long timer_id);
+    /**
+     * Find the nearest moment (in millis() time) when one of the timers is due.
+     * @return false if there are no active timers
+     */
+    [[nodiscard]] bool next_deadline(unsigned long &out_deadline) const;
+
+    TimerId add_timeout(TimerFn callback, unsigned long interval, void *parameter = nullptr);
+    void clear_timeout(TimerId timer_id);
+
+    TimerId add_interval(TimerFn callback, unsigned long interval, void *parameter = nullptr,
+        TimerCatchUp catch_up = TimerCatchUp::COALESCE);
+    void clear_interval(TimerId timer_id);
+
+    /**
+     * Allow timer to be called up to slack ms later than its deadline.
+     * Timer joins the earliest timer already scheduled within [deadline, deadline + slack],
+     * otherwise it's aligned to the coarse boundary within the window, so timers added later can join it.
+     * Grouped timers are called in one pass, which reduces amount of wakeups.
+     * Intervals stay phase-locked to the original deadline.
+     */
+    void set_slack(TimerId timer_id, unsigned long slack);
+
+#if TIMER_INBOX_SIZE > 0
+    /**
+     * Schedule timeout from another task or ISR. It will be added at the beginning of the next handle_timers() call,
+     * but the interval is counted from the moment of posting.
+     * Id is reserved at posting, so the timeout can be cleared by clear_timeout() or post_clear() right away.
+     * Ids are reserved by the loop, so posting is possible only after the first handle_timers() call.
+     * @return TIMER_INVALID_ID if inbox is full
+     */
+    TimerId post_timeout(TimerFn callback, unsigned long interval, void *parameter = nullptr);
+
+    // Clear timeout or interval from another task or ISR. @return false if inbox is full
+    bool post_clear(TimerId timer_id);
 
-    unsigned long add_interval(const TimerFn &callback, unsigned long interval, void *parameter = nullptr);
-    void clear_interval(unsigned long timer_id);
+    // Callback is called after every successful post. It can be called from ISR
+    void set_wakeup_callback(TimerWakeupFn callback) { _wakeup_callback = std::move(callback); }
+#endif
+
+#ifdef TIMER_LATENESS_STATS
+    /**
+     * Histogram of the timer call lateness. Timeouts are released after the call, so it's useful for intervals only.
+     * @return nullptr if timer doesn't exist
+     */
+    [[nodiscard]] const TimerLatenessHistogram *lateness(TimerId timer_id) const;
+    void reset_lateness(TimerId timer_id);
+#endif
+
+#ifdef TIMER_PROFILING
+    void set_name(TimerId timer_id, const char *name);
+
+    /**
+     * Set hook called after every callback which executed at least threshold_us.
+     * Hook is called from handle_timers(), so it shouldn't take long.
+     */
+    void set_slow_callback_hook(unsigned long threshold_us, TimerSlowCallbackFn callback);
+
+    // @return false if timer doesn't exist
+    bool profile(TimerId timer_id, TimerProfile &out_profile) const;
+
+    /**
+     * Copy execution profiles of the active timers.
+     * @return amount of copied profiles
+     */
+    size_t profile_snapshot(TimerProfile *out_profiles, size_t max_count) const;
+    void reset_profiles();
+#endif
 };
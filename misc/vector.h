@@ -1,7 +1,13 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
 #include <new>
+#include <type_traits>
+#include <utility>
 
 #include <lib/debug.h>
 
@@ -9,20 +15,81 @@
 #include <stdexcept>
 #endif
 
+#ifdef ARDUINO_ARCH_ESP32
+#include <esp_heap_caps.h>
+#endif
+
 #ifndef VECTOR_MIN_CAPACITY_GROWTH
 #define VECTOR_MIN_CAPACITY_GROWTH      (8u)
 #endif
 
 #ifndef VECTOR_MAX_CAPACITY_GROWTH
-#define VECTOR_MAX_CAPACITY_GROWTH      (64u)
+#define VECTOR_MAX_CAPACITY_GROWTH      (64u)                   // Used only by VectorLinearGrowth
+#endif
+
+#ifndef VECTOR_GROWTH_FACTOR
+#define VECTOR_GROWTH_FACTOR            (150u)                  // Percent of the current capacity, used by VectorGeometricGrowth
+#endif
+
+static_assert(VECTOR_GROWTH_FACTOR > 100, "VECTOR_GROWTH_FACTOR must be greater than 100");
+
+/**
+ * Growth policy returns capacity used when vector is full.
+ * Geometric growth makes appending amortized O(1), linear growth wastes less memory for small vectors.
+ */
+struct VectorGeometricGrowth {
+    static uint32_t grow(uint32_t capacity) {
+        const uint64_t next = (uint64_t) capacity * VECTOR_GROWTH_FACTOR / 100;
+        return (uint32_t) std::min<uint64_t>(UINT32_MAX, std::max<uint64_t>(capacity + VECTOR_MIN_CAPACITY_GROWTH, next));
+    }
+};
+
+struct VectorLinearGrowth {
+    static uint32_t grow(uint32_t capacity) {
+        return capacity + std::max<uint32_t>(VECTOR_MIN_CAPACITY_GROWTH,
+            std::min<uint32_t>(VECTOR_MAX_CAPACITY_GROWTH, capacity));
+    }
+};
+
+/**
+ * Allocator deals with raw bytes, elements are constructed by Vector.
+ * It can be stateful, Vector keeps a copy of it.
+ * Optional reallocate(ptr, old_size, new_size) is used to grow vectors of trivially copyable types in place.
+ */
+struct VectorHeapAllocator {
+    void *allocate(size_t size) { return malloc(size); }
+    void *reallocate(void *ptr, size_t, size_t size) { return realloc(ptr, size); }
+    void deallocate(void *ptr, size_t) { free(ptr); }
+};
+
+#ifdef ARDUINO_ARCH_ESP32
+// External PSRAM if available, otherwise internal heap
+struct VectorPsramAllocator {
+    void *allocate(size_t size) { return heap_caps_malloc_prefer(size, 2, MALLOC_CAP_SPIRAM, MALLOC_CAP_DEFAULT); }
+    void deallocate(void *ptr, size_t) { heap_caps_free(ptr); }
+};
 #endif
 
+template<typename A, typename = void>
+struct VectorHasReallocate : std::false_type {};
 
-template<typename T>
-class Vector {
-    uint32_t _capacity = 0;
+template<typename A>
+struct VectorHasReallocate<A, std::void_t<decltype(std::declval<A &>().reallocate(nullptr, 0, 0))>> : std::true_type {};
+
+// Allocator with inline_data() and inline_size provides memory used before allocating, see SmallVector
+template<typename A, typename = void>
+struct VectorHasInlineStorage : std::false_type {};
+
+template<typename A>
+struct VectorHasInlineStorage<A, std::void_t<decltype(std::declval<A &>().inline_data()), decltype(A::inline_size)>> : std::true_type {};
+
+
+// Allocator is a base class, so empty allocator doesn't increase vector size
+template<typename T, typename GrowthPolicy = VectorGeometricGrowth, typename Allocator = VectorHeapAllocator>
+class Vector : private Allocator {
+    uint32_t _capacity = _inline_capacity();
     uint32_t _size = 0;
-    uint8_t *_data = nullptr; // Use uint8_t* to avoid call constructor when allocating memory
+    uint8_t *_data = _inline_data(); // Use uint8_t* to avoid call constructor when allocating memory
 
 public:
     T *data() { return (T *) _data; }
@@ -31,15 +98,27 @@ public:
     [[nodiscard]] uint32_t capacity() const { return _capacity; }
     [[nodiscard]] uint32_t size() const { return _size; }
 
+    [[nodiscard]] const Allocator &allocator() const { return *this; }
+
     Vector() = default;
+    explicit Vector(const Allocator &allocator) : Allocator(allocator) {}
     Vector(std::initializer_list<T> init);
     explicit Vector(uint32_t size, T value = {});
 
+    Vector(const Vector &other);
+    Vector(Vector &&other) noexcept;
+
+    Vector &operator=(const Vector &other);
+    Vector &operator=(Vector &&other) noexcept;
+
     ~Vector();
 
     bool reserve(uint32_t capacity);
     void resize(uint32_t size, T value = {});
 
+    // Release unused capacity. Returns false if there is nothing to release
+    bool shrink_to_fit();
+
     void clear();
 
     template<typename... Args> T &emplace(Args... args);
@@ -47,6 +126,19 @@ public:
     void push(T &&value);
     void pop() noexcept;
 
+    // Bulk operations copy trivially copyable types with memcpy. Items must not belong to the vector
+
+    void append(const T *items, uint32_t count);
+    void assign(const T *items, uint32_t count);
+
+    // Returns pointer to the first inserted item or nullptr if index is out of range
+    T *insert(uint32_t index, const T &value) { return insert(index, &value, 1); }
+    T *insert(uint32_t index, const T *items, uint32_t count);
+
+    // Remove items in [from, to)
+    void erase(uint32_t from, uint32_t to);
+    void erase(uint32_t index) { erase(index, index + 1); }
+
     T *at(uint32_t index) noexcept;
     T &operator[](uint32_t index);
     T &operator[](uint32_t index) const;
@@ -59,94 +151,118 @@ public:
 
 private:
     void _grow_if_needed();
+    void _grow_for(uint32_t count);
+    bool _reallocate(uint32_t capacity);
+    void _release();
+    void _take(Vector &other);
+
+    static constexpr uint32_t _inline_capacity() {
+        if constexpr (VectorHasInlineStorage<Allocator>::value) return Allocator::inline_size / sizeof(T);
+        else return 0;
+    }
+
+    uint8_t *_inline_data() {
+        if constexpr (VectorHasInlineStorage<Allocator>::value) return Allocator::inline_data();
+        else return nullptr;
+    }
+
+    bool _is_inline() { return _inline_capacity() > 0 && _data == _inline_data(); }
+
+    static void _copy(T *dst, const T *src, uint32_t count);
+    static void _relocate(T *dst, T *src, uint32_t count);
+    static void _destroy(T *items, uint32_t count);
+
+    static void _on_allocation_failed(size_t size);
 };
 
 
-template<typename T>
-Vector<T>::Vector(uint32_t size, T value) {
+template<typename T, typename G, typename A>
+Vector<T, G, A>::Vector(uint32_t size, T value) {
     resize(size, value);
 }
 
-template<typename T>
-Vector<T>::Vector(std::initializer_list<T> init): Vector(init.size()) {
-    uint32_t index = 0;
-    for (auto &&item: init) {
-        (*this)[index++] = std::move(item);
-    }
+template<typename T, typename G, typename A>
+Vector<T, G, A>::Vector(std::initializer_list<T> init) {
+    assign(init.begin(), init.size());
 }
 
-template<typename T>
-Vector<T>::~Vector() {
-    if (_size == 0) return;
+template<typename T, typename G, typename A>
+Vector<T, G, A>::Vector(const Vector &other) : A(other.allocator()) {
+    assign(other.data(), other._size);
+}
 
-    if constexpr (!std::is_trivially_constructible_v<T>) {
-        for (uint32_t i = 0; i < _size; i++) {
-            ((T *) _data)[i].~T();
-        }
-    }
+template<typename T, typename G, typename A>
+Vector<T, G, A>::Vector(Vector &&other) noexcept : A(std::move(static_cast<A &>(other))) {
+    _take(other);
+}
 
-    delete[] _data;
+template<typename T, typename G, typename A>
+Vector<T, G, A> &Vector<T, G, A>::operator=(const Vector &other) {
+    if (this == &other) return *this;
 
-    _size = 0;
-    _capacity = 0;
-    _data = nullptr;
+    assign(other.data(), other._size);
+    return *this;
 }
 
+template<typename T, typename G, typename A>
+Vector<T, G, A> &Vector<T, G, A>::operator=(Vector &&other) noexcept {
+    if (this == &other) return *this;
 
-template<typename T>
-bool Vector<T>::reserve(uint32_t capacity) {
-    if (capacity <= _capacity) return false;
+    _release();
 
-    VERBOSE(D_PRINTF("Vector::reserve(): Reallocate from %i to %i\r\n", _capacity, capacity));
+    static_cast<A &>(*this) = std::move(static_cast<A &>(other));
+    _take(other);
 
-    uint8_t *old_data = _data;
-    _capacity = capacity;
-    _data = new uint8_t[sizeof(T) * capacity];
+    return *this;
+}
+
+template<typename T, typename G, typename A>
+Vector<T, G, A>::~Vector() {
+    _release();
+}
 
-    for (int i = 0; i < _size; i++) {
-        T &old_item = ((T *) old_data)[i];
-        T *p_new_item = (T *) _data + i;
+template<typename T, typename G, typename A>
+bool Vector<T, G, A>::reserve(uint32_t capacity) {
+    if (capacity <= _capacity) return false;
 
-        if constexpr (std::is_move_constructible_v<T>) {
-            new(p_new_item)T(std::move(old_item));
-        } else if constexpr (std::is_copy_constructible_v<T>) {
-            new(p_new_item)T(old_item);
-        } else {
-            D_PRINT("Vector::reserve(): T is not move or copy constructible");
+    VERBOSE(D_PRINTF("Vector::reserve(): Reallocate from %i to %i\r\n", _capacity, capacity));
+    return _reallocate(capacity);
+}
 
-            delete []_data;
-            _data = old_data;
+template<typename T, typename G, typename A>
+bool Vector<T, G, A>::shrink_to_fit() {
+    if (_size == _capacity || _is_inline()) return false;
 
-#ifdef CONFIG_CXX_EXCEPTIONS
-            throw std::runtime_error("Vector::reserve(): T is not move or copy constructible");
-#else
-            abort();
-#endif
-        }
+    VERBOSE(D_PRINTF("Vector::shrink_to_fit(): Reallocate from %i to %i\r\n", _capacity, _size));
 
-        old_item.~T();
+    if (_size == 0) {
+        _release();
+        return true;
     }
 
-    delete[] old_data;
-    return true;
+    return _reallocate(std::max(_size, _inline_capacity()));
 }
 
-template<typename T>
-void Vector<T>::resize(uint32_t size, T value) {
-    if (size == _size) return;
+template<typename T, typename G, typename A>
+void Vector<T, G, A>::resize(uint32_t size, T value) {
+    if (size < _size) {
+        _destroy(begin() + size, _size - size);
+        _size = size;
+        return;
+    }
 
     reserve(size);
-    while (size < _size) pop();
-    while (size > _size) push(value);
+    for (; _size < size; ++_size) new((T *) _data + _size) T(value);
 }
 
-template<typename T>
-void Vector<T>::clear() {
-    while (_size > 0) pop();
+template<typename T, typename G, typename A>
+void Vector<T, G, A>::clear() {
+    _destroy(begin(), _size);
+    _size = 0;
 }
 
-template<typename T> template<typename... Args>
-T &Vector<T>::emplace(Args... args) {
+template<typename T, typename G, typename A> template<typename... Args>
+T &Vector<T, G, A>::emplace(Args... args) {
     _grow_if_needed();
 
     VERBOSE(D_PRINTF("Vector::emplace() at %u\r\n", _size));
@@ -157,8 +273,8 @@ T &Vector<T>::emplace(Args... args) {
     return *memory;
 }
 
-template<typename T>
-void Vector<T>::push(const T &value) {
+template<typename T, typename G, typename A>
+void Vector<T, G, A>::push(const T &value) {
     _grow_if_needed();
 
     VERBOSE(D_PRINTF("Vector::push(T&) at %u\r\n", _size));
@@ -167,8 +283,8 @@ void Vector<T>::push(const T &value) {
     new(memory) T(value);
 }
 
-template<typename T>
-void Vector<T>::push(T &&value) {
+template<typename T, typename G, typename A>
+void Vector<T, G, A>::push(T &&value) {
     _grow_if_needed();
 
     VERBOSE(D_PRINTF("Vector::push(T&&) at %u\r\n", _size));
@@ -177,8 +293,8 @@ void Vector<T>::push(T &&value) {
     new(memory) T(std::move(value));
 }
 
-template<typename T>
-void Vector<T>::pop() noexcept {
+template<typename T, typename G, typename A>
+void Vector<T, G, A>::pop() noexcept {
     if (_size == 0) return;
 
     --_size;
@@ -187,14 +303,60 @@ void Vector<T>::pop() noexcept {
     }
 }
 
-template<typename T>
-T *Vector<T>::at(uint32_t index) noexcept {
+template<typename T, typename G, typename A>
+void Vector<T, G, A>::append(const T *items, uint32_t count) {
+    if (count == 0) return;
+
+    _grow_for(count);
+
+    _copy(end(), items, count);
+    _size += count;
+}
+
+template<typename T, typename G, typename A>
+void Vector<T, G, A>::assign(const T *items, uint32_t count) {
+    clear();
+    reserve(count);
+
+    _copy(begin(), items, count);
+    _size = count;
+}
+
+template<typename T, typename G, typename A>
+T *Vector<T, G, A>::insert(uint32_t index, const T *items, uint32_t count) {
+    if (index > _size) {
+        D_PRINTF("Vector::insert(%u): Out of range\r\n", index);
+        return nullptr;
+    }
+
+    _grow_for(count);
+
+    T *position = begin() + index;
+    _relocate(position + count, position, _size - index);
+    _copy(position, items, count);
+    _size += count;
+
+    return position;
+}
+
+template<typename T, typename G, typename A>
+void Vector<T, G, A>::erase(uint32_t from, uint32_t to) {
+    to = std::min(to, _size);
+    if (from >= to) return;
+
+    _destroy(begin() + from, to - from);
+    _relocate(begin() + from, begin() + to, _size - to);
+    _size -= to - from;
+}
+
+template<typename T, typename G, typename A>
+T *Vector<T, G, A>::at(uint32_t index) noexcept {
     if (index >= _size) return nullptr;
     return (T *) _data + index;
 }
 
-template<typename T>
-T &Vector<T>::operator[](uint32_t index) {
+template<typename T, typename G, typename A>
+T &Vector<T, G, A>::operator[](uint32_t index) {
     if (index >= _size) {
         D_PRINTF("Vector::operator[%u]: Out of range\r\n", index);
 #ifdef CONFIG_CXX_EXCEPTIONS
@@ -207,17 +369,149 @@ T &Vector<T>::operator[](uint32_t index) {
     return ((T *) _data)[index];
 }
 
-template<typename T> T &Vector<T>::operator[](uint32_t index) const {
+template<typename T, typename G, typename A>
+T &Vector<T, G, A>::operator[](uint32_t index) const {
     return (*const_cast<Vector *>(this))[index];
 }
 
-template<typename T>
-void Vector<T>::_grow_if_needed() {
+template<typename T, typename G, typename A>
+void Vector<T, G, A>::_grow_if_needed() {
     if (_size == _capacity) {
-        auto growth = std::max<uint32_t>(VECTOR_MIN_CAPACITY_GROWTH,
-            std::min<uint32_t>(VECTOR_MAX_CAPACITY_GROWTH, _capacity));
-
-        auto new_size = _capacity + growth;
+        auto new_size = G::grow(_capacity);
         reserve(new_size);
     }
 }
+
+template<typename T, typename G, typename A>
+void Vector<T, G, A>::_grow_for(uint32_t count) {
+    if (_size + count > _capacity) {
+        reserve(std::max(_size + count, G::grow(_capacity)));
+    }
+}
+
+template<typename T, typename G, typename A>
+bool Vector<T, G, A>::_reallocate(uint32_t capacity) {
+    if constexpr (std::is_trivially_copyable_v<T> && VectorHasReallocate<A>::value) {
+        if (_data && !_is_inline() && capacity > _inline_capacity()) {
+            auto *new_data = (uint8_t *) A::reallocate(_data, sizeof(T) * _capacity, sizeof(T) * capacity);
+            if (!new_data) _on_allocation_failed(sizeof(T) * capacity);
+
+            _data = new_data;
+            _capacity = capacity;
+
+            return true;
+        }
+    }
+
+    // Inline storage is used again only when heap memory is shrunk
+    auto *new_data = capacity <= _inline_capacity() ? _inline_data() : (uint8_t *) A::allocate(sizeof(T) * capacity);
+    if (!new_data) _on_allocation_failed(sizeof(T) * capacity);
+
+    if constexpr (std::is_trivially_copyable_v<T>) {
+        if (_size > 0) memcpy(new_data, _data, sizeof(T) * _size);
+    } else {
+        for (uint32_t i = 0; i < _size; i++) {
+            T &old_item = ((T *) _data)[i];
+            T *p_new_item = (T *) new_data + i;
+
+            if constexpr (std::is_move_constructible_v<T>) {
+                new(p_new_item)T(std::move(old_item));
+            } else if constexpr (std::is_copy_constructible_v<T>) {
+                new(p_new_item)T(old_item);
+            } else {
+                D_PRINT("Vector::_reallocate(): T is not move or copy constructible");
+
+                A::deallocate(new_data, sizeof(T) * capacity);
+
+#ifdef CONFIG_CXX_EXCEPTIONS
+                throw std::runtime_error("Vector::_reallocate(): T is not move or copy constructible");
+#else
+                abort();
+#endif
+            }
+
+            old_item.~T();
+        }
+    }
+
+    if (_data && !_is_inline()) A::deallocate(_data, sizeof(T) * _capacity);
+
+    _data = new_data;
+    _capacity = capacity;
+
+    return true;
+}
+
+template<typename T, typename G, typename A>
+void Vector<T, G, A>::_release() {
+    clear();
+
+    if (_data && !_is_inline()) A::deallocate(_data, sizeof(T) * _capacity);
+
+    _capacity = _inline_capacity();
+    _data = _inline_data();
+}
+
+// Inline items can't be stolen, they're moved one by one
+template<typename T, typename G, typename A>
+void Vector<T, G, A>::_take(Vector &other) {
+    if (other._is_inline()) {
+        _relocate(begin(), other.begin(), other._size);
+    } else {
+        _data = other._data;
+        _capacity = other._capacity;
+
+        other._data = other._inline_data();
+        other._capacity = other._inline_capacity();
+    }
+
+    _size = other._size;
+    other._size = 0;
+}
+
+template<typename T, typename G, typename A>
+void Vector<T, G, A>::_copy(T *dst, const T *src, uint32_t count) {
+    if constexpr (std::is_trivially_copyable_v<T>) {
+        if (count > 0) memcpy(dst, src, sizeof(T) * count);
+    } else {
+        for (uint32_t i = 0; i < count; ++i) new(dst + i) T(src[i]);
+    }
+}
+
+// Move items to the uninitialized memory, which can overlap with the source. Source is left uninitialized
+template<typename T, typename G, typename A>
+void Vector<T, G, A>::_relocate(T *dst, T *src, uint32_t count) {
+    if (dst == src || count == 0) return;
+
+    if constexpr (std::is_trivially_copyable_v<T>) {
+        memmove(dst, src, sizeof(T) * count);
+    } else if (dst < src) {
+        for (uint32_t i = 0; i < count; ++i) {
+            new(dst + i) T(std::move(src[i]));
+            src[i].~T();
+        }
+    } else {
+        for (uint32_t i = count; i > 0; --i) {
+            new(dst + i - 1) T(std::move(src[i - 1]));
+            src[i - 1].~T();
+        }
+    }
+}
+
+template<typename T, typename G, typename A>
+void Vector<T, G, A>::_destroy(T *items, uint32_t count) {
+    if constexpr (!std::is_trivially_destructible_v<T>) {
+        for (uint32_t i = 0; i < count; ++i) items[i].~T();
+    }
+}
+
+template<typename T, typename G, typename A>
+void Vector<T, G, A>::_on_allocation_failed([[maybe_unused]] size_t size) {
+    D_PRINTF("Vector: Unable to allocate %u bytes\r\n", size);
+
+#ifdef CONFIG_CXX_EXCEPTIONS
+    throw std::bad_alloc();
+#else
+    abort();
+#endif
+}
@@ -90,7 +90,7 @@ Future<EspNowSendResponse> AsyncEspNowInteraction::_send_impl(
     const uint8_t *data_ptr = data;
     uint8_t index = 0;
 
-    std::vector<Future<void>> futures;
+    SmallVector<Future<void>, ESP_NOW_INTERACTION_INLINE_PACKETS_COUNT> futures;
     uint16_t remaining = size;
     while (remaining > 0) {
         const auto packet_data_size = (uint8_t) std::min<uint16_t>(remaining, ESP_NOW_INTERACTION_MAX_PACKET_DATA_LENGTH);
@@ -108,7 +108,7 @@ Future<EspNowSendResponse> AsyncEspNowInteraction::_send_impl(
         memcpy(packet + ESP_NOW_INTERACTION_PACKET_HEADER_LENGTH, data_ptr, packet_data_size);
 
         auto future = _async_now.send(mac_addr, packet, sizeof(packet));
-        futures.push_back(std::move(future));
+        futures.push(std::move(future));
 
         D_PRINTF("EspNowInteraction: sending message %i packet %i/%i, size %i\r\n",
             header->id, header->index + 1, header->count, header->size);
@@ -117,7 +117,7 @@ Future<EspNowSendResponse> AsyncEspNowInteraction::_send_impl(
         remaining -= packet_data_size;
     }
 
-    return PromiseBase::all(futures).then<EspNowSendResponse>([id](const FutureBase &) {
+    return PromiseBase::all(futures.data(), futures.size()).then<EspNowSendResponse>([id](const FutureBase &) {
         return EspNowSendResponse {.id = id};
     });
 }
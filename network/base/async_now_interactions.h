@@ -4,6 +4,10 @@
 
 #include "async_now.h"
 
+#ifndef ESP_NOW_INTERACTION_INLINE_PACKETS_COUNT
+#define ESP_NOW_INTERACTION_INLINE_PACKETS_COUNT            (4u)                // Packets of the message sent without heap allocation
+#endif
+
 struct __attribute__((__packed__)) EspNowInteractionPacketHeader {
     uint8_t id;
     bool is_response;
@@ -12,7 +12,7 @@ class BinaryProtocol {
     static_assert(std::is_enum_v<PacketEnumT>, "PacketEnumT should be an enum");
 
 public:
-    PacketParsingResponse<PacketEnumT> parse_packet(const uint8_t *buffer, uint8_t length);
+    PacketParsingResponse<PacketEnumT> parse_packet(const uint8_t *buffer, uint16_t length);
 
     template<typename T, typename = std::enable_if<std::is_enum<T>::value || std::is_integral<T>::value>>
     Response update_parameter_value(T *parameter, const PacketHeader<PacketEnumT> &header, const void *data);
@@ -32,7 +32,7 @@ public:
 };
 
 template<typename PacketEnumT>
-PacketParsingResponse<PacketEnumT> BinaryProtocol<PacketEnumT>::parse_packet(const uint8_t *buffer, uint8_t length) {
+PacketParsingResponse<PacketEnumT> BinaryProtocol<PacketEnumT>::parse_packet(const uint8_t *buffer, uint16_t length) {
     D_PRINT("Parsing packet:");
     D_WRITE("---- Packet body: ");
     D_PRINT_HEX(buffer, length);
@@ -53,8 +53,8 @@ public:
 
     template<typename T, typename = std::enable_if_t<!std::is_pointer_v<T> && std::is_standard_layout_v<T>>>
     Future<void> send(const uint8_t *mac_addr, uint8_t type, const std::vector<T> &items);
-    template<typename T, typename = std::enable_if_t<!std::is_pointer_v<T> && std::is_standard_layout_v<T>>>
-    Future<void> send(const uint8_t *mac_addr, uint8_t type, const Vector<T> &items);
+    template<typename T, typename G, typename A, typename = std::enable_if_t<!std::is_pointer_v<T> && std::is_standard_layout_v<T>>>
+    Future<void> send(const uint8_t *mac_addr, uint8_t type, const Vector<T, G, A> &items);
     template<typename T, size_t Count, typename = std::enable_if_t<!std::is_pointer_v<T> && std::is_standard_layout_v<T>>>
     Future<void> send(const uint8_t *mac_addr, uint8_t type, const T (&items)[Count]);
     template<typename T, typename = std::enable_if_t<!std::is_pointer_v<T> && std::is_standard_layout_v<T>>>
@@ -64,8 +64,8 @@ public:
 
     template<typename T, typename = std::enable_if_t<!std::is_pointer_v<T> && std::is_standard_layout_v<T>>>
     Future<NowPacket> request(const uint8_t *mac_addr, uint8_t type, const std::vector<T> &items);
-    template<typename T, typename = std::enable_if_t<!std::is_pointer_v<T> && std::is_standard_layout_v<T>>>
-    Future<NowPacket> request(const uint8_t *mac_addr, uint8_t type, const Vector<T> &items);
+    template<typename T, typename G, typename A, typename = std::enable_if_t<!std::is_pointer_v<T> && std::is_standard_layout_v<T>>>
+    Future<NowPacket> request(const uint8_t *mac_addr, uint8_t type, const Vector<T, G, A> &items);
     template<typename T, size_t Count, typename = std::enable_if_t<!std::is_pointer_v<T> && std::is_standard_layout_v<T>>>
     Future<NowPacket> request(const uint8_t *mac_addr, uint8_t type, const T (&items)[Count]);
     template<typename T, typename = std::enable_if_t<!std::is_pointer_v<T> && std::is_standard_layout_v<T>>>
@@ -75,8 +75,8 @@ public:
 
     template<typename T, typename = std::enable_if_t<!std::is_pointer_v<T> && std::is_standard_layout_v<T>>>
     Future<void> respond(uint8_t id, const uint8_t *mac_addr, uint8_t type, const std::vector<T> &items);
-    template<typename T, typename = std::enable_if_t<!std::is_pointer_v<T> && std::is_standard_layout_v<T>>>
-    Future<void> respond(uint8_t id, const uint8_t *mac_addr, uint8_t type, const Vector<T> &items);
+    template<typename T, typename G, typename A, typename = std::enable_if_t<!std::is_pointer_v<T> && std::is_standard_layout_v<T>>>
+    Future<void> respond(uint8_t id, const uint8_t *mac_addr, uint8_t type, const Vector<T, G, A> &items);
     template<typename T, size_t Count, typename = std::enable_if_t<!std::is_pointer_v<T> && std::is_standard_layout_v<T>>>
     Future<void> respond(uint8_t id, const uint8_t *mac_addr, uint8_t type, const T (&items)[Count]);
     template<typename T, typename = std::enable_if_t<!std::is_pointer_v<T> && std::is_standard_layout_v<T>>>
@@ -107,8 +107,8 @@ Future<void> NowIo::send(const uint8_t *mac_addr, uint8_t type, const std::vecto
     return send(mac_addr, type, items.size(), (uint8_t *) items.data(), sizeof(T) * items.size());
 }
 
-template<typename T, typename>
-Future<void> NowIo::send(const uint8_t *mac_addr, uint8_t type, const Vector<T> &items) {
+template<typename T, typename G, typename A, typename>
+Future<void> NowIo::send(const uint8_t *mac_addr, uint8_t type, const Vector<T, G, A> &items) {
     return send(mac_addr, type, items.size(), (uint8_t *) items.data(), sizeof(T) * items.size());
 }
 
@@ -127,8 +127,8 @@ Future<NowPacket> NowIo::request(const uint8_t *mac_addr, uint8_t type, const st
     return request(mac_addr, type, items.size(), (uint8_t *) items.data(), sizeof(T) * items.size());
 }
 
-template<typename T, typename>
-Future<NowPacket> NowIo::request(const uint8_t *mac_addr, uint8_t type, const Vector<T> &items) {
+template<typename T, typename G, typename A, typename>
+Future<NowPacket> NowIo::request(const uint8_t *mac_addr, uint8_t type, const Vector<T, G, A> &items) {
     return request(mac_addr, type, items.size(), (uint8_t *) items.data(), sizeof(T) * items.size());
 }
 
@@ -147,7 +147,8 @@ Future<void> NowIo::respond(uint8_t id, const uint8_t *mac_addr, uint8_t type, c
     return respond(id, mac_addr, type, (uint8_t *) items.data(), sizeof(T) * items.size());
 }
 
-template<typename T, typename> Future<void> NowIo::respond(uint8_t id, const uint8_t *mac_addr, uint8_t type, const Vector<T> &items) {
+template<typename T, typename G, typename A, typename>
+Future<void> NowIo::respond(uint8_t id, const uint8_t *mac_addr, uint8_t type, const Vector<T, G, A> &items) {
     return respond(id, mac_addr, type, (uint8_t *) items.data(), sizeof(T) * items.size());
 }
 
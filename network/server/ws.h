@@ -5,7 +5,7 @@
 
 #include "../../debug.h"
 #include "../../base/parameter.h"
-#include "../../misc/circular_buffer.h"
+#include "../../misc/byte_circular_buffer.h"
 #include "../../misc/notification_bus.h"
 #include "../protocol/binary.h"
 #include "../protocol/type.h"
@@ -22,12 +22,18 @@
 #define WS_MAX_PACKET_QUEUE                     (10u)
 #endif
 
-struct WebSocketRequest {
-    uint32_t client_id = 0;
-    size_t size = 0;
-    uint8_t data[WS_MAX_PACKET_SIZE] = {};
+#ifndef WS_REQUEST_QUEUE_SIZE
+#define WS_REQUEST_QUEUE_SIZE                   (WS_MAX_PACKET_QUEUE * WS_MAX_PACKET_SIZE)  // Bytes shared by queued packets
+#endif
+
+// Queued request: [header] [packet]
+struct WebSocketRequestHeader {
+    uint32_t client_id;
 };
 
+static_assert(sizeof(WebSocketRequestHeader) + WS_MAX_PACKET_SIZE + sizeof(uint32_t) < WS_REQUEST_QUEUE_SIZE / 2,
+              "WS_REQUEST_QUEUE_SIZE should be at least twice bigger than WS_MAX_PACKET_SIZE");
+
 typedef std::function<void(const void *data, uint16_t size)> WebSocketCommand;
 
 template<typename PacketEnumT>
@@ -42,7 +48,8 @@ class WebSocketServer {
     std::map<PacketEnumT, AbstractParameter *> _parameters;
     std::map<const AbstractParameter *, PacketEnumT> _parameters_packet_type;
 
-    CircularBuffer<WebSocketRequest, WS_MAX_PACKET_QUEUE> _request_queue;
+    // Filled by AsyncTCP task, processed by the loop
+    ByteCircularBuffer<WS_REQUEST_QUEUE_SIZE> _request_queue;
 
     const char *_path;
     AsyncWebSocket _ws;
@@ -121,16 +128,19 @@ template<typename PacketEnumT>
 void WebSocketServer<PacketEnumT>::handle_connection() {
     _ws.cleanupClients();
 
-    while (_request_queue.can_pop()) {
-        auto &request = *_request_queue.pop();
+    // Request is released after the response is sent, packet data points into it
+    if (auto request = _request_queue.peek()) {
+        WebSocketRequestHeader header;
+        memcpy(&header, request.data, sizeof(header));
 
-        auto parsing_response = _protocol.parse_packet(request.data, request.size);
+        auto parsing_response = _protocol.parse_packet(request.data + sizeof(header), request.size - sizeof(header));
 
         Response response = parsing_response.success
-                            ? handle_packet_data(request.client_id, parsing_response.packet)
+                            ? handle_packet_data(header.client_id, parsing_response.packet)
                             : parsing_response.response;
 
-        return send_response(request.client_id, parsing_response.request_id, response);
+        send_response(header.client_id, parsing_response.request_id, response);
+        _request_queue.release();
     }
 }
 
@@ -232,17 +242,18 @@ void WebSocketServer<PacketEnumT>::on_event(
                 return;
             }
 
-            if (!_request_queue.can_acquire()) {
+            auto request = _request_queue.acquire(sizeof(WebSocketRequestHeader) + len);
+            if (!request) {
                 D_PRINT("WebSocket: packet dropped. Queue is full");
                 send_response(client->id(), ~(uint16_t) 0, Response::code(ResponseCode::TOO_MANY_REQUEST));
                 return;
             }
 
-            auto &request = *_request_queue.acquire();
+            const WebSocketRequestHeader header{.client_id = client->id()};
+            memcpy(request.data, &header, sizeof(header));
+            memcpy(request.data + sizeof(header), data, len);
 
-            request.client_id = client->id();
-            request.size = len;
-            memcpy(request.data, data, len);
+            _request_queue.commit();
 
             break;
         }
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * CRC-32 (IEEE 802.3) with 16-entry table to keep flash usage small.
+ * Pass result of the previous call as crc to continue calculation over multiple buffers.
+ */
+inline uint32_t crc32_calc(const void *data, size_t size, uint32_t crc = 0) {
+    static constexpr uint32_t TABLE[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+    };
+
+    auto *ptr = (const uint8_t *) data;
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = TABLE[(crc ^ ptr[i]) & 0x0f] ^ (crc >> 4);
+        crc = TABLE[(crc ^ (ptr[i] >> 4)) & 0x0f] ^ (crc >> 4);
+    }
+
+    return ~crc;
+}
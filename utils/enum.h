@@ -1,13 +1,29 @@
 #pragma once
 
 #include "macro.h"
+#include <cstddef>
 #include <cstdio>
 
 #define __ENUM_VALUE(Name, _1, _2) _1 = _2,
 #define __ENUM_CASE(Name, _1, _2) case Name::_1: return #_1;
+#define __ENUM_SIZE(Name, _1, _2) if ((size_t) Name::_1 >= _size) _size = (size_t) Name::_1 + 1;
 
 #define __ENUM_VALUE_AUTO(Name, _1) _1,
 #define __ENUM_CASE_AUTO(Name, _1) case Name::_1: return #_1;
+#define __ENUM_SIZE_AUTO(Name, _1) + 1
+
+// __enum_size(Name) is the size of an array indexed by enum value
+#define __MAKE_ENUM_SIZE(Name, ...)                                             \
+    constexpr size_t __enum_size(Name) {                                        \
+        size_t _size = 0;                                                       \
+        FOR_EACH_OPTS_2(__ENUM_SIZE, Name, __VA_ARGS__)                         \
+        return _size;                                                           \
+    }
+
+#define __MAKE_ENUM_AUTO_SIZE(Name, ...)                                        \
+    constexpr size_t __enum_size(Name) {                                        \
+        return 0 FOR_EACH_OPTS_1(__ENUM_SIZE_AUTO, Name, __VA_ARGS__);          \
+    }
 
 
 #ifdef DEBUG
@@ -25,7 +41,8 @@
                 return _str;                                                      \
             }                                                                     \
         }                                                                         \
-    }
+    }                                                                             \
+    __MAKE_ENUM_SIZE(Name, __VA_ARGS__)
 
 #define MAKE_ENUM_AUTO(Name, Type, ...)                                                \
     enum class Name: Type { FOR_EACH_OPTS_1(__ENUM_VALUE_AUTO, Name, __VA_ARGS__)  };  \
@@ -38,17 +55,20 @@
                 return _str;                                                      \
             }                                                                     \
         }                                                                         \
-    }
+    }                                                                             \
+    __MAKE_ENUM_AUTO_SIZE(Name, __VA_ARGS__)
 #else
 #define MAKE_ENUM(Name, Type, ...)                                                  \
     enum class Name: Type { FOR_EACH_OPTS_2(__ENUM_VALUE, Name, __VA_ARGS__)  };    \
     constexpr const char * __debug_enum_str(Name _e) {                              \
         return "*** Debug info deleted ***";                                        \
-    }
+    }                                                                               \
+    __MAKE_ENUM_SIZE(Name, __VA_ARGS__)
 
 #define MAKE_ENUM_AUTO(Name, Type, ...)                                               \
     enum class Name: Type { FOR_EACH_OPTS_1(__ENUM_VALUE_AUTO, Name, __VA_ARGS__)  }; \
     constexpr const char * __debug_enum_str(Name _e) {                                \
         return "*** Debug info deleted ***";                                          \
-    }
+    }                                                                                 \
+    __MAKE_ENUM_AUTO_SIZE(Name, __VA_ARGS__)
 #endif
\ No newline at end of file